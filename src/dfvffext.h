@@ -0,0 +1,126 @@
+/*
+   This file is part of DirectFB.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __DFVFFEXT_H__
+#define __DFVFFEXT_H__
+
+#include <dfvff.h>
+
+/*
+ * Aligned frame layout.
+ *
+ * If DFVFF_FLAG_ALIGNED is set in DFVFFHeader.flags, the header is followed by a DFVFFLayout structure. The first
+ * frame starts at 'frame_offset' from the start of the file and each frame is padded to 'frame_size' bytes, both
+ * being multiples of 'alignment', so that frames can be mapped or read directly into aligned buffers. The planes of
+ * a frame start at 'plane_offset', they may also be aligned, otherwise they follow each other. The pitch of each
+ * plane is unchanged. The minor version number is then 1 at least, as players not aware of the layout would take it
+ * for the first frame.
+ */
+
+#define DFVFF_FLAG_ALIGNED  0x02
+
+typedef struct {
+     u32           alignment;       /* boundary of the first frame and of the frame size, a power of two */
+     u32           frame_offset;    /* byte offset of the first frame from the start of the file */
+     u32           frame_size;      /* distance between frames in bytes, including padding */
+     u32           num_planes;      /* number of planes of the pixel format */
+     u32           plane_offset[3]; /* byte offset of each plane from the start of the frame */
+     u32           reserved;
+} DFVFFLayout;
+
+/* Extension headers following the layout keep their 64 bit offsets aligned. */
+_Static_assert( sizeof(DFVFFLayout) == 32, "DFVFFLayout size must be 32" );
+
+/*
+ * Compressed frames.
+ *
+ * If DFVFF_FLAG_COMPRESSED is set in DFVFFHeader.flags, the header is followed by a DFVFFCompression structure and
+ * frames have a variable size. They are located by an index of 'num_frames' DFVFFFrameEntry structures at
+ * 'index_offset', after the last frame and zero padding up to a multiple of 8 bytes, so that the index can be read in
+ * place from a mapped file. The minor version number is then 1 at least. This flag excludes DFVFF_FLAG_ALIGNED.
+ *
+ * With DFVFF_CODEC_RLE, the bytes of a frame (laid out as in an uncompressed file) are coded as a sequence of runs,
+ * each one starting with a token byte: bit 7 is set for a repeated byte, cleared for literal bytes, bits 0-6 give
+ * the run length minus one, the value 127 meaning 128 plus a length following as an unsigned LEB128 number. Then
+ * follows the repeated byte, or the literal bytes. Keyframes code the frame itself. Other frames code the difference
+ * (modulo 256) of each byte with the previous frame, so that decoding adds the runs to the previous frame in place,
+ * skipping runs of zero. Frames can be decoded in parallel from each keyframe.
+ *
+ * Files written as a stream, without seeking back to complete the header, have an 'index_offset' of 0 after the
+ * header, the completed DFVFFCompression structure then being the last bytes of the file, after the index.
+ */
+
+#define DFVFF_FLAG_COMPRESSED  0x04
+
+typedef enum {
+     DFVFF_CODEC_RLE = 1    /* run length coding of frames or of their difference with the previous frame */
+} DFVFFCodec;
+
+typedef struct {
+     u32           codec;             /* DFVFFCodec */
+     u32           keyframe_interval; /* maximum number of frames from one keyframe to the next */
+     u32           num_frames;        /* number of entries in the frame index */
+     u32           reserved;
+     u64           index_offset;      /* byte offset of the frame index from the start of the file */
+} DFVFFCompression;
+
+_Static_assert( sizeof(DFVFFCompression) == 24, "DFVFFCompression size must be 24" );
+
+#define DFVFF_FRAME_KEY     0x01
+#define DFVFF_FRAME_REPEAT  0x02
+
+typedef struct {
+     u64           offset;            /* byte offset of the frame from the start of the file */
+     u32           size;              /* byte size of the compressed frame */
+     u32           flags;             /* DFVFF_FRAME_KEY for frames not depending on the previous one,
+                                         DFVFF_FRAME_REPEAT (and a size of 0) for a repeat of the previous one */
+} DFVFFFrameEntry;
+
+/*
+ * Repeated frames.
+ *
+ * If DFVFF_FLAG_REPEATS is set in DFVFFHeader.flags, frames repeating the previous one are only stored once. The
+ * header is followed by a DFVFFRepeats structure, after the DFVFFLayout structure if any, and by the stored frames.
+ * A table of 'num_repeats' DFVFFRepeatEntry structures at 'table_offset', after the last stored frame and zero
+ * padding up to a multiple of 8 bytes, sorted by stored frame, gives the number of times a stored frame is shown
+ * again after itself. The minor version number is then 1 at least. This flag excludes DFVFF_FLAG_COMPRESSED,
+ * compressed files have DFVFF_FRAME_REPEAT entries in their frame index instead.
+ *
+ * Repeats are either identical to the stored frame or within a maximum difference of each byte, as given by
+ * 'threshold'. As for compressed frames, files written as a stream have a 'table_offset' of 0 after the header, the
+ * completed DFVFFRepeats structure being the last bytes of the file, after the table.
+ */
+
+#define DFVFF_FLAG_REPEATS  0x08
+
+typedef struct {
+     u32           num_frames;        /* number of frames shown, including repeats */
+     u32           num_repeats;       /* number of entries in the repeat table */
+     u32           threshold;         /* maximum difference of each byte of a repeat, 0 for identical frames */
+     u32           reserved;
+     u64           table_offset;      /* byte offset of the repeat table from the start of the file */
+} DFVFFRepeats;
+
+_Static_assert( sizeof(DFVFFRepeats) == 24, "DFVFFRepeats size must be 24" );
+
+typedef struct {
+     u32           frame;             /* index of the stored frame */
+     u32           count;             /* number of times the frame is repeated */
+} DFVFFRepeatEntry;
+
+#endif
@@ -16,17 +16,235 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
-#include <dfvff.h>
+#include <dfvffext.h>
 #include <direct/filesystem.h>
 #include <directfb_util.h>
 
 /**********************************************************************************************************************/
 
+/*
+ * Returns the extension header at the offset, or its trailer at the end of the file if the header was not completed.
+ */
+static const void *get_extension( const u8 *data, size_t length, size_t offset, size_t size )
+{
+     /* The table offset is at the end of both extension headers. */
+     if (length < offset + size)
+          return NULL;
+
+     if (*(const u64*) (data + offset + size - sizeof(u64)))
+          return data + offset;
+
+     if (length < offset + 2 * size)
+          return NULL;
+
+     return data + length - size;
+}
+
+static const DFVFFRepeats *get_repeats( const u8 *data, size_t length )
+{
+     const DFVFFHeader *header = (const DFVFFHeader*) data;
+     size_t             offset = sizeof(DFVFFHeader);
+
+     if (header->flags & DFVFF_FLAG_ALIGNED)
+          offset += sizeof(DFVFFLayout);
+
+     if (!(header->flags & DFVFF_FLAG_REPEATS))
+          return NULL;
+
+     return get_extension( data, length, offset, sizeof(DFVFFRepeats) );
+}
+
+static bool check_layout( const char *filename, const u8 *data, size_t length )
+{
+     const DFVFFHeader  *header  = (const DFVFFHeader*) data;
+     const DFVFFLayout  *layout  = (const DFVFFLayout*) (data + sizeof(DFVFFHeader));
+     const DFVFFRepeats *repeats = get_repeats( data, length );
+     int                 i;
+     u64                 frame_size;
+
+     if (length < sizeof(DFVFFHeader) + sizeof(DFVFFLayout)) {
+          fprintf( stderr, "%s: layout exceeds the file!\n", filename );
+          return false;
+     }
+
+     if (!layout->alignment || !layout->frame_size || layout->num_planes > 3 || layout->frame_offset > length) {
+          fprintf( stderr, "%s: invalid layout!\n", filename );
+          return false;
+     }
+
+     /* The planes of a frame add up to the size of an unaligned frame, padding excluded. */
+     frame_size = (u64) DFB_BYTES_PER_LINE( header->format, header->width ) *
+                  DFB_PLANE_MULTIPLY( header->format, header->height );
+
+     if (layout->frame_size < frame_size || layout->frame_size % layout->alignment) {
+          fprintf( stderr, "%s: frame size of the layout does not match the format!\n", filename );
+          return false;
+     }
+
+     for (i = 0; i < layout->num_planes; i++) {
+          if (layout->plane_offset[i] >= layout->frame_size ||
+              (i && layout->plane_offset[i] <= layout->plane_offset[i-1])) {
+               fprintf( stderr, "%s: plane %d of the layout is invalid!\n", filename, i );
+               return false;
+          }
+     }
+
+     /* Stored frames end at the repeat table. */
+     if (repeats && repeats->table_offset >= layout->frame_offset && repeats->table_offset <= length)
+          length = repeats->table_offset;
+
+     printf( "  aligned to %u bytes: first frame at %u, %u bytes per frame, %llu frames\n",
+             layout->alignment, layout->frame_offset, layout->frame_size,
+             (unsigned long long) (length - layout->frame_offset) / layout->frame_size );
+
+     for (i = 0; i < layout->num_planes; i++)
+          printf( "  plane %d at %u%s\n", i, layout->plane_offset[i],
+                  layout->plane_offset[i] % layout->alignment ? "" : " (aligned)" );
+
+     return true;
+}
+
+static bool check_compression( const char *filename, const u8 *data, size_t length )
+{
+     const DFVFFHeader      *header     = (const DFVFFHeader*) data;
+     const DFVFFCompression *compressed = get_extension( data, length, sizeof(DFVFFHeader), sizeof(DFVFFCompression) );
+     const DFVFFFrameEntry  *index;
+     u32                     i;
+     u32                     keyframes  = 0;
+     u32                     repeats    = 0;
+     u64                     bytes      = 0;
+     u64                     frame_size;
+
+     if (!compressed) {
+          fprintf( stderr, "%s: compression header exceeds the file!\n", filename );
+          return false;
+     }
+
+     if (compressed->index_offset > length ||
+         (u64) compressed->num_frames * sizeof(DFVFFFrameEntry) > length - compressed->index_offset) {
+          fprintf( stderr, "%s: frame index exceeds the file!\n", filename );
+          return false;
+     }
+
+     if (compressed->index_offset % 8) {
+          fprintf( stderr, "%s: frame index is not aligned!\n", filename );
+          return false;
+     }
+
+     index = (const DFVFFFrameEntry*) (data + compressed->index_offset);
+
+     for (i = 0; i < compressed->num_frames; i++) {
+          if (index[i].offset > compressed->index_offset ||
+              index[i].size > compressed->index_offset - index[i].offset) {
+               fprintf( stderr, "%s: frame %u exceeds the file!\n", filename, i );
+               return false;
+          }
+
+          if (index[i].flags & DFVFF_FRAME_KEY)
+               keyframes++;
+
+          if (index[i].flags & DFVFF_FRAME_REPEAT)
+               repeats++;
+
+          bytes += index[i].size;
+     }
+
+     if (compressed->num_frames && !(index[0].flags & DFVFF_FRAME_KEY)) {
+          fprintf( stderr, "%s: first frame is not a keyframe!\n", filename );
+          return false;
+     }
+
+     frame_size = (u64) DFB_BYTES_PER_LINE( header->format, header->width ) *
+                  DFB_PLANE_MULTIPLY( header->format, header->height );
+
+     printf( "  compressed (%s): %u frames, %u keyframes (interval %u), %u repeats, %llu bytes, ratio %.1f%%\n",
+             compressed->codec == DFVFF_CODEC_RLE ? "rle" : "unknown", compressed->num_frames, keyframes,
+             compressed->keyframe_interval, repeats, (unsigned long long) bytes,
+             compressed->num_frames ? 100.0 * bytes / ((double) compressed->num_frames * frame_size) : 0.0 );
+
+     return true;
+}
+
+static bool check_repeats( const char *filename, const u8 *data, size_t length )
+{
+     const DFVFFHeader      *header  = (const DFVFFHeader*) data;
+     const DFVFFLayout      *layout  = (const DFVFFLayout*) (data + sizeof(DFVFFHeader));
+     const DFVFFRepeats     *repeats = get_repeats( data, length );
+     const DFVFFRepeatEntry *table;
+     u32                     i;
+     u64                     first;
+     u64                     frame_size;
+     u64                     stored;
+     u64                     shown;
+
+     if (!repeats) {
+          fprintf( stderr, "%s: repeat header exceeds the file!\n", filename );
+          return false;
+     }
+
+     if (header->flags & DFVFF_FLAG_COMPRESSED) {
+          fprintf( stderr, "%s: compressed frames can not have a repeat table!\n", filename );
+          return false;
+     }
+
+     if (repeats->table_offset > length ||
+         (u64) repeats->num_repeats * sizeof(DFVFFRepeatEntry) > length - repeats->table_offset) {
+          fprintf( stderr, "%s: repeat table exceeds the file!\n", filename );
+          return false;
+     }
+
+     if (repeats->table_offset % 8) {
+          fprintf( stderr, "%s: repeat table is not aligned!\n", filename );
+          return false;
+     }
+
+     if (header->flags & DFVFF_FLAG_ALIGNED) {
+          first      = layout->frame_offset;
+          frame_size = layout->frame_size;
+     }
+     else {
+          first      = sizeof(DFVFFHeader) + sizeof(DFVFFRepeats);
+          frame_size = (u64) DFB_BYTES_PER_LINE( header->format, header->width ) *
+                       DFB_PLANE_MULTIPLY( header->format, header->height );
+     }
+
+     if (!frame_size || first > repeats->table_offset) {
+          fprintf( stderr, "%s: invalid repeat table!\n", filename );
+          return false;
+     }
+
+     table  = (const DFVFFRepeatEntry*) (data + repeats->table_offset);
+     stored = (repeats->table_offset - first) / frame_size;
+     shown  = stored;
+
+     for (i = 0; i < repeats->num_repeats; i++) {
+          if (table[i].frame >= stored || (i && table[i].frame <= table[i-1].frame)) {
+               fprintf( stderr, "%s: repeat entry %u is invalid!\n", filename, i );
+               return false;
+          }
+
+          shown += table[i].count;
+     }
+
+     if (shown != repeats->num_frames) {
+          fprintf( stderr, "%s: repeat table does not match the number of frames!\n", filename );
+          return false;
+     }
+
+     printf( "  repeats (threshold %u): %u frames, %llu stored, %llu repeated in %u runs\n",
+             repeats->threshold, repeats->num_frames, (unsigned long long) stored,
+             (unsigned long long) (shown - stored), repeats->num_repeats );
+
+     return true;
+}
+
 int main( int argc, char *argv[] )
 {
-     DFBResult    ret;
-     DirectFile   file;
-     DFVFFHeader *header;
+     DFBResult          ret;
+     DirectFile         file;
+     DirectFileInfo     info;
+     const DFVFFHeader *header;
+     const u8          *data = NULL;
 
      /* Parse the command line. */
      if (argc != 2) {
@@ -42,16 +260,31 @@ int main( int argc, char *argv[] )
           return 1;
      }
 
+     ret = direct_file_get_info( &file, &info );
+     if (ret) {
+          fprintf( stderr, "Failed during get_info() of '%s'!\n", argv[1] );
+          goto out;
+     }
+
+     if (info.size < sizeof(DFVFFHeader)) {
+          fprintf( stderr, "File '%s' is too small!\n", argv[1] );
+          ret = DFB_FAILURE;
+          goto out;
+     }
+
      /* Memory-mapped file. */
-     ret = direct_file_map( &file, NULL, 0, sizeof(DFVFFHeader), DFP_READ, (void**) &header );
+     ret = direct_file_map( &file, NULL, 0, info.size, DFP_READ, (void**) &data );
      if (ret) {
           fprintf( stderr, "Failed during mmap() of '%s'!\n", argv[1] );
           goto out;
      }
 
+     header = (const DFVFFHeader*) data;
+
      /* Check the magic. */
      if (strncmp( (const char*) header, "DFVFF", 5 )) {
           fprintf( stderr, "Bad magic in '%s'!\n", argv[1] );
+          ret = DFB_FAILURE;
           goto out;
      }
 
@@ -59,7 +292,19 @@ int main( int argc, char *argv[] )
              header->width, header->height, dfb_pixelformat_name( header->format ),
              dfb_colorspace_name( header->colorspace ), header->framerate_num, header->framerate_den );
 
+     if ((header->flags & DFVFF_FLAG_ALIGNED) && !check_layout( argv[1], data, info.size ))
+          ret = DFB_FAILURE;
+
+     if ((header->flags & DFVFF_FLAG_COMPRESSED) && !check_compression( argv[1], data, info.size ))
+          ret = DFB_FAILURE;
+
+     if ((header->flags & DFVFF_FLAG_REPEATS) && !check_repeats( argv[1], data, info.size ))
+          ret = DFB_FAILURE;
+
 out:
+     if (data)
+          direct_file_unmap( (void*) data, info.size );
+
      direct_file_close( &file );
 
      return !ret ? 0 : 1;
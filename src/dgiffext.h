@@ -0,0 +1,134 @@
+/*
+   This file is part of DirectFB.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __DGIFFEXT_H__
+#define __DGIFFEXT_H__
+
+#include <dgiff.h>
+
+/*
+ * Optional face directory.
+ *
+ * If DGIFF_FLAG_FACE_DIRECTORY is set in DGIFFHeader.flags, the header is followed by 'num_faces' DGIFFFaceEntry
+ * structures, before the first face. The minor version number is then 1 at least, as loaders not aware of the
+ * directory would take it for the first face. DGIFFFaceHeader.next_face is still valid within the face chain.
+ */
+
+#define DGIFF_FLAG_FACE_DIRECTORY  0x02
+
+typedef struct {
+     u32           size;        /* size of the face */
+     u32           offset;      /* byte offset of the face header from the start of the file */
+     u32           length;      /* byte length of the face, including its extension tables */
+     u32           pixelformat; /* pixel format of the glyph images */
+} DGIFFFaceEntry;
+
+/*
+ * Glyph pages.
+ *
+ * If DGIFF_FLAG_PAGES is set in DGIFFHeader.flags, each DGIFFGlyphRow of a face is a page of a fixed size holding
+ * several lines of glyphs, the vertical position of each glyph within its page being given by a DGIFF_EXT_PAGE
+ * extension table. The minor version number is then 1 at least.
+ */
+
+#define DGIFF_FLAG_PAGES           0x04
+
+/*
+ * Optional per face extension tables.
+ *
+ * Extension tables are stored after the data of the last glyph row of a face, within the span covered by
+ * DGIFFFaceHeader.next_face, so that loaders not aware of them simply skip them. Each table starts with a
+ * DGIFFExtHeader, the list is terminated by a DGIFF_EXT_END header.
+ */
+
+#define DGIFF_EXT_TAG(a,b,c,d)  ((u32) (a) | ((u32) (b) << 8) | ((u32) (c) << 16) | ((u32) (d) << 24))
+
+typedef enum {
+     DGIFF_EXT_END   = 0,
+     DGIFF_EXT_INDEX = DGIFF_EXT_TAG( 'I', 'N', 'D', 'X' ), /* glyph lookup index */
+     DGIFF_EXT_KERN  = DGIFF_EXT_TAG( 'K', 'E', 'R', 'N' ), /* kerning pairs */
+     DGIFF_EXT_SDF   = DGIFF_EXT_TAG( 'S', 'D', 'F', ' ' ), /* signed distance field glyphs */
+     DGIFF_EXT_PAGE  = DGIFF_EXT_TAG( 'P', 'A', 'G', 'E' )  /* vertical glyph positions within pages */
+} DGIFFExtType;
+
+typedef struct {
+     u32           type;        /* DGIFFExtType */
+     u32           size;        /* byte size of the table following this header */
+} DGIFFExtHeader;
+
+/*
+ * Glyph lookup index (DGIFF_EXT_INDEX).
+ *
+ * A direct indexed block of 'num_direct' glyph indices for code points 0 to num_direct - 1 (DGIFF_INDEX_NONE for
+ * missing characters), followed by 'num_sorted' entries for all other code points, sorted by unicode value.
+ */
+
+#define DGIFF_INDEX_DIRECT  256
+#define DGIFF_INDEX_NONE    0xFFFFFFFF
+
+typedef struct {
+     u32           num_direct;  /* number of entries in the direct indexed block */
+     u32           num_sorted;  /* number of entries in the sorted table */
+} DGIFFIndexHeader;
+
+typedef struct {
+     u32           unicode;     /* unicode character code */
+     u32           glyph;       /* index into the DGIFFGlyphInfo table of the face */
+} DGIFFIndexEntry;
+
+/*
+ * Kerning pairs (DGIFF_EXT_KERN).
+ *
+ * 'num_pairs' entries with non zero kerning in pixels at the face size, sorted by left then right unicode value.
+ */
+
+typedef struct {
+     u32           num_pairs;   /* number of kerning pairs */
+} DGIFFKerningHeader;
+
+typedef struct {
+     u32           left;        /* unicode character code of the left glyph */
+     u32           right;       /* unicode character code of the right glyph */
+     s16           x;           /* horizontal kerning */
+     s16           y;           /* vertical kerning */
+} DGIFFKerningPair;
+
+/*
+ * Signed distance field glyphs (DGIFF_EXT_SDF).
+ *
+ * The A8 glyph images of the face contain a signed distance to the glyph outline instead of a coverage: 128 is on
+ * the outline, greater values are inside. A value v is at a distance of (v - 128) * spread / 127 pixels at the
+ * face size, so that the coverage of a pixel at size s can be reconstructed as
+ *
+ *   clamp( 0.5 + (v - 128) * spread * s / (127 * size), 0, 1 )
+ *
+ * Glyph metrics and kerning are given at the face size and scale linearly.
+ */
+
+typedef struct {
+     u32           spread;      /* distance in pixels at the face size for a value of 1 or 255 */
+} DGIFFDistanceField;
+
+/*
+ * Vertical glyph positions within pages (DGIFF_EXT_PAGE).
+ *
+ * One u32 per glyph, in the order of the DGIFFGlyphInfo table. The page of a glyph is given by its 'row' field and
+ * its horizontal position within the page by its 'offset' field.
+ */
+
+#endif
@@ -0,0 +1,272 @@
+/*
+   This file is part of DirectFB.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include <dgiffext.h>
+#include <direct/filesystem.h>
+#include <directfb_util.h>
+
+/**********************************************************************************************************************/
+
+static const char *ext_name( u32 type )
+{
+     switch (type) {
+          case DGIFF_EXT_INDEX:
+               return "index";
+          case DGIFF_EXT_KERN:
+               return "kerning";
+          case DGIFF_EXT_SDF:
+               return "distance field";
+          case DGIFF_EXT_PAGE:
+               return "page";
+          default:
+               return "unknown";
+     }
+}
+
+static bool check_face( const char *filename, const u8 *data, size_t length, int index, bool pages )
+{
+     const DGIFFFaceHeader *face = (const DGIFFFaceHeader*) data;
+     const DGIFFGlyphInfo  *glyphs;
+     const DGIFFGlyphRow  **rows;
+     const u8              *ptr;
+     const u8              *ext_start;
+     const u32             *glyph_y      = NULL;
+     int                    i;
+     u64                    atlas_bytes  = 0;
+     u64                    atlas_pixels = 0;
+     u64                    glyph_pixels = 0;
+
+     if (length < sizeof(DGIFFFaceHeader) || face->next_face < sizeof(DGIFFFaceHeader) || face->next_face > length) {
+          fprintf( stderr, "%s: face %d exceeds the file!\n", filename, index );
+          return false;
+     }
+
+     length = face->next_face;
+
+     if ((u64) face->num_glyphs * sizeof(DGIFFGlyphInfo) > length - sizeof(DGIFFFaceHeader)) {
+          fprintf( stderr, "%s: glyph table of face %d exceeds the face!\n", filename, index );
+          return false;
+     }
+
+     glyphs = (const DGIFFGlyphInfo*) (face + 1);
+     ptr    = (const u8*) (glyphs + face->num_glyphs);
+
+     rows = malloc( face->num_rows * sizeof(DGIFFGlyphRow*) );
+     if (!rows && face->num_rows) {
+          fprintf( stderr, "%s: could not allocate %u rows!\n", filename, face->num_rows );
+          return false;
+     }
+
+     /* Rows are variable sized, walk them to locate each one. */
+     for (i = 0; i < face->num_rows; i++) {
+          const DGIFFGlyphRow *row = (const DGIFFGlyphRow*) ptr;
+
+          if (ptr + sizeof(DGIFFGlyphRow) > data + length ||
+              row->width < 0 || row->height < 0 || row->pitch < 0 ||
+              (u64) row->height * row->pitch > (u64) (data + length - ptr - sizeof(DGIFFGlyphRow))) {
+               fprintf( stderr, "%s: row %d of face %d exceeds the face!\n", filename, i, index );
+               free( rows );
+               return false;
+          }
+
+          if (DFB_BYTES_PER_LINE( face->pixelformat, row->width ) > row->pitch) {
+               fprintf( stderr, "%s: row %d of face %d has an invalid pitch!\n", filename, i, index );
+               free( rows );
+               return false;
+          }
+
+          rows[i] = row;
+
+          atlas_bytes  += (u64) row->height * row->pitch;
+          atlas_pixels += (u64) row->height * row->width;
+
+          ptr += sizeof(DGIFFGlyphRow) + row->height * row->pitch;
+     }
+
+     ext_start = ptr;
+
+     /* Optional extension tables. */
+     while (ptr < data + length) {
+          const DGIFFExtHeader *ext = (const DGIFFExtHeader*) ptr;
+
+          if (ptr + sizeof(DGIFFExtHeader) > data + length ||
+              ext->size > (u64) (data + length - ptr - sizeof(DGIFFExtHeader))) {
+               fprintf( stderr, "%s: extension table of face %d exceeds the face!\n", filename, index );
+               free( rows );
+               return false;
+          }
+
+          if (ext->type == DGIFF_EXT_END)
+               break;
+
+          if (ext->type == DGIFF_EXT_PAGE) {
+               if (ext->size != face->num_glyphs * sizeof(u32)) {
+                    fprintf( stderr, "%s: page table of face %d has an invalid size!\n", filename, index );
+                    free( rows );
+                    return false;
+               }
+
+               glyph_y = (const u32*) (ext + 1);
+          }
+
+          ptr += sizeof(DGIFFExtHeader) + ext->size;
+     }
+
+     /* Faces have a page table if and only if the header says so. */
+     if (!glyph_y != !pages) {
+          fprintf( stderr, "%s: face %d %s a page table, %s in the header!\n", filename, index,
+                   glyph_y ? "has" : "lacks", pages ? "flagged" : "not flagged" );
+          free( rows );
+          return false;
+     }
+
+     for (i = 0; i < face->num_glyphs; i++) {
+          const DGIFFGlyphInfo *glyph = &glyphs[i];
+
+          if (glyph->row >= face->num_rows || glyph->offset < 0 || glyph->width < 0 || glyph->height < 0 ||
+              glyph->offset + glyph->width > rows[glyph->row]->width ||
+              (glyph_y ? glyph_y[i] : 0) + glyph->height > rows[glyph->row]->height) {
+               fprintf( stderr, "%s: glyph 0x%x of face %d is out of its row!\n", filename, glyph->unicode, index );
+               free( rows );
+               return false;
+          }
+
+          glyph_pixels += glyph->width * glyph->height;
+     }
+
+     free( rows );
+
+     printf( "  size %3d: %5u glyphs, %4u rows, %s, atlas %9llu bytes, fill ratio %5.1f%%\n",
+             face->size, face->num_glyphs, face->num_rows, dfb_pixelformat_name( face->pixelformat ),
+             (unsigned long long) atlas_bytes, atlas_pixels ? 100.0 * glyph_pixels / atlas_pixels : 0.0 );
+
+     for (ptr = ext_start; ptr < data + length;) {
+          const DGIFFExtHeader *ext = (const DGIFFExtHeader*) ptr;
+
+          if (ext->type == DGIFF_EXT_END)
+               break;
+
+          printf( "            %s table, %u bytes\n", ext_name( ext->type ), ext->size );
+
+          ptr += sizeof(DGIFFExtHeader) + ext->size;
+     }
+
+     return true;
+}
+
+int main( int argc, char *argv[] )
+{
+     DFBResult             ret;
+     DirectFile            file;
+     DirectFileInfo        info;
+     const DGIFFHeader    *header;
+     const DGIFFFaceEntry *entries = NULL;
+     const u8             *data    = NULL;
+     size_t                offset;
+     int                   i;
+     bool                  valid   = true;
+
+     /* Parse the command line. */
+     if (argc != 2) {
+          fprintf( stderr, "\nDirectFB Glyph Image File Format Information\n\n" );
+          fprintf( stderr, "Usage: %s <fontfile>\n\n", argv[0] );
+          return 1;
+     }
+
+     /* Open the file. */
+     ret = direct_file_open( &file, argv[1], O_RDONLY, 0 );
+     if (ret) {
+          fprintf( stderr, "Failed to open '%s'!\n", argv[1] );
+          return 1;
+     }
+
+     ret = direct_file_get_info( &file, &info );
+     if (ret) {
+          fprintf( stderr, "Failed during get_info() of '%s'!\n", argv[1] );
+          goto out;
+     }
+
+     if (info.size < sizeof(DGIFFHeader)) {
+          fprintf( stderr, "File '%s' is too small!\n", argv[1] );
+          ret = DFB_FAILURE;
+          goto out;
+     }
+
+     /* Memory-mapped file. */
+     ret = direct_file_map( &file, NULL, 0, info.size, DFP_READ, (void**) &data );
+     if (ret) {
+          fprintf( stderr, "Failed during mmap() of '%s'!\n", argv[1] );
+          goto out;
+     }
+
+     header = (const DGIFFHeader*) data;
+
+     /* Check the magic. */
+     if (strncmp( (const char*) header, "DGIFF", 5 )) {
+          fprintf( stderr, "Bad magic in '%s'!\n", argv[1] );
+          ret = DFB_FAILURE;
+          goto out;
+     }
+
+     printf( "%s: %u faces, %zu bytes\n", argv[1], header->num_faces, (size_t) info.size );
+
+     offset = sizeof(DGIFFHeader);
+
+     if (header->flags & DGIFF_FLAG_FACE_DIRECTORY) {
+          if ((u64) header->num_faces * sizeof(DGIFFFaceEntry) > info.size - offset) {
+               fprintf( stderr, "%s: face directory exceeds the file!\n", argv[1] );
+               ret = DFB_FAILURE;
+               goto out;
+          }
+
+          entries = (const DGIFFFaceEntry*) (data + offset);
+
+          offset += header->num_faces * sizeof(DGIFFFaceEntry);
+     }
+
+     for (i = 0; i < header->num_faces; i++) {
+          const DGIFFFaceHeader *face = (const DGIFFFaceHeader*) (data + offset);
+
+          if (!check_face( argv[1], data + offset, info.size - offset, i, header->flags & DGIFF_FLAG_PAGES )) {
+               valid = false;
+               break;
+          }
+
+          if (entries && (entries[i].offset != offset || entries[i].length != face->next_face ||
+                          entries[i].size != face->size || entries[i].pixelformat != face->pixelformat)) {
+               fprintf( stderr, "%s: face directory entry %d does not match the face chain!\n", argv[1], i );
+               valid = false;
+          }
+
+          offset += face->next_face;
+     }
+
+     if (valid && offset != info.size)
+          printf( "  %zu trailing bytes\n", (size_t) (info.size - offset) );
+
+     if (!valid)
+          ret = DFB_FAILURE;
+
+out:
+     if (data)
+          direct_file_unmap( (void*) data, info.size );
+
+     direct_file_close( &file );
+
+     return !ret ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+/*
+   This file is part of DirectFB.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include <direct/util.h>
+#include <glyphrow.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**********************************************************************************************************************/
+
+/* Expansion of 8 mono pixels to 8 gray pixels. */
+static u8 mono_to_gray[256][8];
+
+/* Bit reversal of 8 mono pixels. */
+static u8 mono_to_lsb[256];
+
+void init_row_tables()
+{
+     int i, n;
+
+     for (i = 0; i < 256; i++) {
+          mono_to_lsb[i] = 0;
+
+          for (n = 0; n < 8; n++) {
+               mono_to_gray[i][n] = (i & (0x80 >> n)) ? 0xFF : 0x00;
+
+               if (i & (0x80 >> n))
+                    mono_to_lsb[i] |= 1 << n;
+          }
+     }
+}
+
+static void gray_row_argb( const u8 *src, void *dst, int width )
+{
+     int  i   = 0;
+     u32 *d32 = dst;
+
+#ifdef __SSE2__
+     const __m128i zero = _mm_setzero_si128();
+     const __m128i rgb  = _mm_set1_epi32( 0xFFFFFF );
+
+     for (; i + 16 <= width; i += 16) {
+          __m128i s  = _mm_loadu_si128( (const __m128i*) (src + i) );
+          __m128i lo = _mm_unpacklo_epi8( zero, s );
+          __m128i hi = _mm_unpackhi_epi8( zero, s );
+
+          _mm_storeu_si128( (__m128i*) (d32 + i),      _mm_or_si128( _mm_unpacklo_epi16( zero, lo ), rgb ) );
+          _mm_storeu_si128( (__m128i*) (d32 + i + 4),  _mm_or_si128( _mm_unpackhi_epi16( zero, lo ), rgb ) );
+          _mm_storeu_si128( (__m128i*) (d32 + i + 8),  _mm_or_si128( _mm_unpacklo_epi16( zero, hi ), rgb ) );
+          _mm_storeu_si128( (__m128i*) (d32 + i + 12), _mm_or_si128( _mm_unpackhi_epi16( zero, hi ), rgb ) );
+     }
+#endif
+
+     for (; i < width; i++)
+          d32[i] = (src[i] << 24) | 0xFFFFFF;
+}
+
+static void gray_row_argb_premultiplied( const u8 *src, void *dst, int width )
+{
+     int  i   = 0;
+     u32 *d32 = dst;
+
+#ifdef __SSE2__
+     for (; i + 16 <= width; i += 16) {
+          __m128i s  = _mm_loadu_si128( (const __m128i*) (src + i) );
+          __m128i lo = _mm_unpacklo_epi8( s, s );
+          __m128i hi = _mm_unpackhi_epi8( s, s );
+
+          _mm_storeu_si128( (__m128i*) (d32 + i),      _mm_unpacklo_epi16( lo, lo ) );
+          _mm_storeu_si128( (__m128i*) (d32 + i + 4),  _mm_unpackhi_epi16( lo, lo ) );
+          _mm_storeu_si128( (__m128i*) (d32 + i + 8),  _mm_unpacklo_epi16( hi, hi ) );
+          _mm_storeu_si128( (__m128i*) (d32 + i + 12), _mm_unpackhi_epi16( hi, hi ) );
+     }
+#endif
+
+     for (; i < width; i++)
+          d32[i] = (src[i] << 24) | (src[i] << 16) | (src[i] << 8) | src[i];
+}
+
+static void gray_row_airgb( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u32 *d32 = dst;
+
+     for (i = 0; i < width; i++)
+          d32[i] = ((src[i] ^ 0xFF) << 24) | 0xFFFFFF;
+}
+
+static inline void store24( u8 *d8, u32 d )
+{
+#ifdef WORDS_BIGENDIAN
+     d8[0] = (d >> 16) & 0xFF;
+     d8[1] = (d >>  8) & 0xFF;
+     d8[2] =  d        & 0xFF;
+#else
+     d8[0] =  d        & 0xFF;
+     d8[1] = (d >>  8) & 0xFF;
+     d8[2] = (d >> 16) & 0xFF;
+#endif
+}
+
+static void gray_row_argb8565( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u8  *d8 = dst;
+
+     for (i = 0; i < width; i++, d8 += 3)
+          store24( d8, (src[i] << 16) | 0xFFFF );
+}
+
+static void gray_row_argb6666( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u8  *d8 = dst;
+
+     for (i = 0; i < width; i++, d8 += 3)
+          store24( d8, (src[i] << 16) | 0x3FFFF );
+}
+
+static void gray_row_argb4444( const u8 *src, void *dst, int width )
+{
+     int  i   = 0;
+     u16 *d16 = dst;
+
+#ifdef __SSE2__
+     const __m128i zero = _mm_setzero_si128();
+     const __m128i rgb  = _mm_set1_epi16( 0xFFF );
+
+     for (; i + 16 <= width; i += 16) {
+          __m128i s = _mm_loadu_si128( (const __m128i*) (src + i) );
+
+          _mm_storeu_si128( (__m128i*) (d16 + i),     _mm_or_si128( _mm_unpacklo_epi8( zero, s ), rgb ) );
+          _mm_storeu_si128( (__m128i*) (d16 + i + 8), _mm_or_si128( _mm_unpackhi_epi8( zero, s ), rgb ) );
+     }
+#endif
+
+     for (; i < width; i++)
+          d16[i] = (src[i] << 8) | 0xFFF;
+}
+
+static void gray_row_rgba4444( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u16 *d16 = dst;
+
+     for (i = 0; i < width; i++)
+          d16[i] = 0xFFF0 | ((src[i] & 0xF0) >> 4);
+}
+
+static void gray_row_argb2554( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u16 *d16 = dst;
+
+     for (i = 0; i < width; i++)
+          d16[i] = (src[i] << 8) | 0x3FFF;
+}
+
+static void gray_row_argb1555( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u16 *d16 = dst;
+
+     for (i = 0; i < width; i++)
+          d16[i] = (src[i] << 8) | 0x7FFF;
+}
+
+static void gray_row_rgba5551( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u16 *d16 = dst;
+
+     for (i = 0; i < width; i++)
+          d16[i] = 0xFFFE | ((src[i] & 0x80) >> 7);
+}
+
+static void gray_row_rgbaf88871( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u32 *d32 = dst;
+
+     for (i = 0; i < width; i++)
+          d32[i] = 0xFFFFFF00 | (src[i] & 0xFE);
+}
+
+static void gray_row_a8( const u8 *src, void *dst, int width )
+{
+     memcpy( dst, src, width );
+}
+
+static void gray_row_a4( const u8 *src, void *dst, int width )
+{
+     int  i  = 0;
+     u8  *d8 = dst;
+
+#ifdef __SSE2__
+     const __m128i high = _mm_set1_epi16( 0xF0 );
+
+     for (; i + 32 <= width; i += 32) {
+          __m128i s0 = _mm_loadu_si128( (const __m128i*) (src + i) );
+          __m128i s1 = _mm_loadu_si128( (const __m128i*) (src + i + 16) );
+
+          s0 = _mm_or_si128( _mm_and_si128( s0, high ), _mm_srli_epi16( s0, 12 ) );
+          s1 = _mm_or_si128( _mm_and_si128( s1, high ), _mm_srli_epi16( s1, 12 ) );
+
+          _mm_storeu_si128( (__m128i*) (d8 + i / 2), _mm_packus_epi16( s0, s1 ) );
+     }
+#endif
+
+     for (; i + 1 < width; i += 2)
+          d8[i/2] = (src[i] & 0xF0) | (src[i+1] >> 4);
+
+     if (i < width)
+          d8[i/2] = src[i] & 0xF0;
+}
+
+static void gray_row_a1( const u8 *src, void *dst, int width )
+{
+     int  i, j, n;
+     u8  *d8 = dst;
+
+     for (i = 0, j = 0; i < width; ++j) {
+          u8 p = 0;
+          for (n = 0; n < 8 && i < width; ++i, ++n)
+               p |= (src[i] & 0x80) >> n;
+          d8[j] = p;
+     }
+}
+
+static void gray_row_a1_lsb( const u8 *src, void *dst, int width )
+{
+     int  i, j, n;
+     u8  *d8 = dst;
+
+     for (i = 0, j = 0; i < width; ++j) {
+          u8 p = 0;
+          for (n = 0; n < 8 && i < width; ++i, ++n)
+               p |= (src[i] & 0x80) >> (7 - n);
+          d8[j] = p;
+     }
+}
+
+static void mono_row_a8( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u8  *d8 = dst;
+
+     for (i = 0; i + 8 <= width; i += 8)
+          memcpy( d8 + i, mono_to_gray[src[i>>3]], 8 );
+
+     if (i < width)
+          memcpy( d8 + i, mono_to_gray[src[i>>3]], width - i );
+}
+
+static void mono_row_a1( const u8 *src, void *dst, int width )
+{
+     memcpy( dst, src, DFB_BYTES_PER_LINE( DSPF_A1, width ) );
+}
+
+static void mono_row_a1_lsb( const u8 *src, void *dst, int width )
+{
+     int  i;
+     u8  *d8 = dst;
+
+     for (i = 0; i < DFB_BYTES_PER_LINE( DSPF_A1_LSB, width ); i++)
+          d8[i] = mono_to_lsb[src[i]];
+}
+
+DFBBoolean select_row_funcs( GlyphRowFuncs *funcs, DFBSurfacePixelFormat format, bool premultiplied )
+{
+     funcs->format = format;
+     funcs->mono   = NULL;
+
+     switch (format) {
+          case DSPF_ABGR:
+          case DSPF_ARGB:
+               funcs->gray = premultiplied ? gray_row_argb_premultiplied : gray_row_argb;
+               break;
+          case DSPF_AiRGB:
+               funcs->gray = gray_row_airgb;
+               break;
+          case DSPF_ARGB8565:
+               funcs->gray = gray_row_argb8565;
+               break;
+          case DSPF_ARGB1666:
+          case DSPF_ARGB6666:
+               funcs->gray = gray_row_argb6666;
+               break;
+          case DSPF_ARGB4444:
+               funcs->gray = gray_row_argb4444;
+               break;
+          case DSPF_RGBA4444:
+               funcs->gray = gray_row_rgba4444;
+               break;
+          case DSPF_ARGB2554:
+               funcs->gray = gray_row_argb2554;
+               break;
+          case DSPF_ARGB1555:
+               funcs->gray = gray_row_argb1555;
+               break;
+          case DSPF_RGBA5551:
+               funcs->gray = gray_row_rgba5551;
+               break;
+          case DSPF_RGBAF88871:
+               funcs->gray = gray_row_rgbaf88871;
+               break;
+          case DSPF_A8:
+               funcs->gray = gray_row_a8;
+               funcs->mono = mono_row_a8;
+               break;
+          case DSPF_A4:
+               funcs->gray = gray_row_a4;
+               break;
+          case DSPF_A1:
+               funcs->gray = gray_row_a1;
+               funcs->mono = mono_row_a1;
+               break;
+          case DSPF_A1_LSB:
+               funcs->gray = gray_row_a1_lsb;
+               funcs->mono = mono_row_a1_lsb;
+               break;
+          default:
+               fprintf( stderr, "Unsupported format for glyph rendering!\n" );
+               return DFB_FALSE;
+     }
+
+     return DFB_TRUE;
+}
+
+static void mono_row_expand( const GlyphRowFuncs *funcs, const u8 *src, u8 *dst, int width )
+{
+     int i, x;
+     u8  buf[64];
+
+     /* Expand to fully transparent or opaque gray pixels, then convert in chunks of 64 pixels. */
+     for (x = 0; x < width; x += 64) {
+          int n = MIN( 64, width - x );
+
+          for (i = 0; i < n; i += 8)
+               memcpy( buf + i, mono_to_gray[src[(x+i)>>3]], 8 );
+
+          funcs->gray( buf, dst + DFB_BYTES_PER_LINE( funcs->format, x ), n );
+     }
+}
+
+FT_Error write_glyph( const GlyphRowFuncs *funcs, const DGIFFGlyphInfo *glyph, FT_GlyphSlot slot, void *dst, int pitch )
+{
+     int  y;
+     u8  *src = slot->bitmap.buffer;
+
+     switch (slot->bitmap.pixel_mode) {
+          case ft_pixel_mode_grays:
+               for (y = 0; y < glyph->height; y++) {
+                    funcs->gray( src, dst, glyph->width );
+
+                    src += slot->bitmap.pitch;
+                    dst += pitch;
+               }
+               break;
+
+          case ft_pixel_mode_mono:
+               for (y = 0; y < glyph->height; y++) {
+                    if (funcs->mono)
+                         funcs->mono( src, dst, glyph->width );
+                    else
+                         mono_row_expand( funcs, src, dst, glyph->width );
+
+                    src += slot->bitmap.pitch;
+                    dst += pitch;
+               }
+               break;
+
+          default:
+               break;
+     }
+
+     return FT_Err_Ok;
+}
@@ -0,0 +1,62 @@
+/*
+   This file is part of DirectFB.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __GLYPHROW_H__
+#define __GLYPHROW_H__
+
+#include <dgiff.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+/*
+ * Glyph row writers.
+ *
+ * Each function converts one row of 8 bit coverage values (or of 1 bit coverage values for the mono variants) to
+ * the destination format. They are selected once per pixel format by select_row_funcs().
+ */
+
+typedef void (*GlyphRowFunc)( const u8 *src, void *dst, int width );
+
+typedef struct {
+     DFBSurfacePixelFormat format;   /* destination format */
+     GlyphRowFunc          gray;     /* ft_pixel_mode_grays source */
+     GlyphRowFunc          mono;     /* ft_pixel_mode_mono source, NULL to expand to gray and use the gray function */
+} GlyphRowFuncs;
+
+/*
+ * Fill the mono expansion tables, to be called once before using any mono row writer.
+ */
+void       init_row_tables ( void );
+
+/*
+ * Select the row writers for a destination pixel format.
+ */
+DFBBoolean select_row_funcs( GlyphRowFuncs         *funcs,
+                             DFBSurfacePixelFormat  format,
+                             bool                   premultiplied );
+
+/*
+ * Convert the bitmap of a rendered glyph slot to the destination format, 'glyph' giving its width and height.
+ */
+FT_Error   write_glyph     ( const GlyphRowFuncs   *funcs,
+                             const DGIFFGlyphInfo  *glyph,
+                             FT_GlyphSlot           slot,
+                             void                  *dst,
+                             int                    pitch );
+
+#endif
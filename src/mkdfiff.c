@@ -16,7 +16,7 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
-#include <dfiff.h>
+#include <dfiffext.h>
 #include <directfb_strings.h>
 #include <gfx/convert.h>
 #include <png.h>
@@ -475,8 +475,6 @@ static DFIFFHeader header = {
      flags: 0x01
 };
 
-#define DFIFF_FLAG_PREMULTIPLIED 0x02
-
 int main( int argc, char *argv[] )
 {
      int                   i;
@@ -16,16 +16,74 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
-#include <dfvff.h>
+#include <dfvffext.h>
+#include <direct/clock.h>
 #include <direct/util.h>
 #include <directfb_strings.h>
+#include <fcntl.h>
 #include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/parseutils.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
+#include <limits.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#include <pthread.h>
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+#include <sys/uio.h>
+
+#define RING_SIZE     8
+#define MAX_VARIANTS  8
+#define MAX_JOBS      64
+#define MIN_RUN       4
+#define COPY_CHUNK    (64 << 20)
+#define HASH_SEED     0xcbf29ce484222325ull
+
+#define ALIGN_DOWN(v,shift)  ((v) & ~((1 << (shift)) - 1))
+#define ALIGN_UP(v,bytes)    (((v) + (bytes) - 1) & ~((bytes) - 1))
+#define RLE_BOUND(length)    ((length) + (length) / 64 + 16)
+
+#ifndef IOV_MAX
+#define IOV_MAX       1024
+#endif
+
+typedef enum {
+     FIT_STRETCH,
+     FIT_LETTERBOX,
+     FIT_CROP
+} FitMode;
+
+typedef struct {
+     const char            *filename;
+     DFBSurfacePixelFormat  format;
+     int                    width;
+     int                    height;
+     DFBSurfaceColorSpace   colorspace;
+} OutputSpec;
 
 static const DirectFBPixelFormatNames(format_names);
 static const DirectFBColorSpaceNames(colorspace_names);
 
+static const struct {
+     const char *name;
+     int         flags;
+} scaler_names[] = {
+     { "fast",     SWS_FAST_BILINEAR },
+     { "bilinear", SWS_BILINEAR      },
+     { "bicubic",  SWS_BICUBIC       },
+     { "area",     SWS_AREA          },
+     { "lanczos",  SWS_LANCZOS       },
+     { "spline",   SWS_SPLINE        }
+};
+
+static const char *fit_names[] = { "stretch", "letterbox", "crop" };
+
 static const char            *filename   = NULL;
+static const char            *output     = NULL;
 static bool                   debug      = false;
 static DFBSurfacePixelFormat  format     = DSPF_UNKNOWN;
 static int                    width      = 0;
@@ -34,6 +92,24 @@ static unsigned int           fps_num    = 0;
 static unsigned int           fps_den    = 1;
 static DFBSurfaceColorSpace   colorspace = DSCS_UNKNOWN;
 static unsigned long          nframes    = 0;
+static int64_t                start_time = 0;
+static int64_t                duration   = 0;
+static int                    out_width  = 0;
+static int                    out_height = 0;
+static int                    scaler     = SWS_FAST_BILINEAR;
+static FitMode                fit        = FIT_STRETCH;
+static OutputSpec             variants[MAX_VARIANTS];
+static int                    num_variants = 0;
+static int                    jobs         = 1;
+static unsigned int           alignment    = 0;
+static bool                   align_planes = false;
+static bool                   compression  = false;
+static unsigned int           keyframe_interval = 25;
+static bool                   benchmark    = false;
+static bool                   elide        = false;
+static unsigned int           threshold    = 0;
+static bool                   convert_rate = false;
+static bool                   blend        = false;
 
 #define DEBUG(...)                             \
      do {                                      \
@@ -48,14 +124,31 @@ static void print_usage()
      int i = 0;
 
      fprintf( stderr, "DirectFB Fast Video File Format Tool\n\n" );
-     fprintf( stderr, "Usage: mkdfvff [options] <video>\n\n" );
+     fprintf( stderr, "Usage: mkdfvff [options] <video>\n" );
+     fprintf( stderr, "       mkdfvff [options] -s <width>x<height> -r <rate> -f <pixelformat> -\n\n" );
      fprintf( stderr, "Options:\n\n" );
      fprintf( stderr, "  -d, --debug                           Output debug information.\n" );
      fprintf( stderr, "  -f, --format     <pixelformat>        Choose the pixel format.\n" );
      fprintf( stderr, "  -s, --size       <width>x<height>     Set video frame size (for raw input video).\n" );
-     fprintf( stderr, "  -r, --rate       <fps_num>/<fps_den>  Choose the frame rate (for raw input video).\n" );
+     fprintf( stderr, "  -r, --rate       <fps_num>/<fps_den>  Choose the frame rate (converting decoded video).\n" );
      fprintf( stderr, "  -c, --colorspace <colorspace>         Choose the color space.\n" );
      fprintf( stderr, "  -n, --nframes    <nframes>            Set the number of video frames to output.\n" );
+     fprintf( stderr, "  -t, --start      <time>               Start at this position of the input video.\n" );
+     fprintf( stderr, "  -l, --duration   <time>               Limit the duration of the output video.\n" );
+     fprintf( stderr, "  -o, --output     <file>               Write to a file instead of the standard output.\n" );
+     fprintf( stderr, "  -O, --variant    <options>            Also write a variant of the decoded video to a file.\n" );
+     fprintf( stderr, "  -S, --scale      <width>x<height>     Scale decoded video frames to this size.\n" );
+     fprintf( stderr, "  -q, --quality    <scaler>             Choose the scaler (default: fast).\n" );
+     fprintf( stderr, "  -m, --fit        <mode>               Keep the aspect ratio when scaling (default: stretch).\n" );
+     fprintf( stderr, "  -j, --jobs       <jobs>               Decode this many segments of the video in parallel.\n" );
+     fprintf( stderr, "  -a, --align      <bytes>|page         Align the frames in the file to this boundary.\n" );
+     fprintf( stderr, "  -p, --align-planes                    Also align each plane of the frames.\n" );
+     fprintf( stderr, "  -z, --compress                        Compress the frames, with a frame index.\n" );
+     fprintf( stderr, "  -k, --keyframes  <interval>           Set the interval of compressed keyframes (default: 25).\n" );
+     fprintf( stderr, "  -b, --benchmark                       Measure the decoding speed of compressed frames.\n" );
+     fprintf( stderr, "  -e, --elide                           Store frames repeating the previous one only once.\n" );
+     fprintf( stderr, "  -E, --threshold  <difference>         Also elide frames differing by this much per byte.\n" );
+     fprintf( stderr, "  -B, --blend                           Blend frames dropped by the rate conversion.\n" );
      fprintf( stderr, "  -h, --help                            Show this help message.\n\n" );
      fprintf( stderr, "Supported pixel formats:\n\n" );
      while (format_names[i].format != DSPF_UNKNOWN) {
@@ -82,9 +175,22 @@ static void print_usage()
           ++i;
      }
      fprintf( stderr, "\n" );
+     fprintf( stderr, "Supported scalers:\n\n" );
+     for (i = 0; i < D_ARRAY_SIZE(scaler_names); i++)
+          fprintf( stderr, "  %s\n", scaler_names[i].name );
+     fprintf( stderr, "\n" );
+     fprintf( stderr, "Supported fit modes:\n\n" );
+     for (i = 0; i < D_ARRAY_SIZE(fit_names); i++)
+          fprintf( stderr, "  %s\n", fit_names[i] );
+     fprintf( stderr, "\n" );
+     fprintf( stderr, "Output variant options (defaulting to the main output ones):\n\n" );
+     fprintf( stderr, "  file=<file>,format=<pixelformat>,scale=<width>x<height>,colorspace=<colorspace>\n\n" );
+     fprintf( stderr, "The video is decoded once for all outputs. The main output is not written if variants are given\n" );
+     fprintf( stderr, "without the -o option.\n" );
+     fprintf( stderr, "\n" );
 }
 
-static DFBBoolean parse_format( const char *arg )
+static DFBBoolean parse_format( const char *arg, DFBSurfacePixelFormat *ret_format )
 {
      int i = 0;
 
@@ -92,7 +198,7 @@ static DFBBoolean parse_format( const char *arg )
           if (!strcasecmp( arg, format_names[i].name )          &&
               DFB_BYTES_PER_PIXEL( format_names[i].format ) < 3 &&
               DFB_COLOR_IS_YUV   ( format_names[i].format )) {
-               format = format_names[i].format;
+               *ret_format = format_names[i].format;
                return DFB_TRUE;
           }
           ++i;
@@ -115,7 +221,7 @@ static DFBBoolean parse_size( const char *arg )
 
 static DFBBoolean parse_rate( const char *arg )
 {
-     if (sscanf( arg, "%u/%u", &fps_num, &fps_den ) == 2)
+     if (sscanf( arg, "%u/%u", &fps_num, &fps_den ) == 2 && fps_num && fps_den)
           return DFB_TRUE;
 
      fprintf( stderr, "Invalid frame rate specified!\n" );
@@ -123,14 +229,14 @@ static DFBBoolean parse_rate( const char *arg )
      return DFB_FALSE;
 }
 
-static DFBBoolean parse_colorspace( const char *arg )
+static DFBBoolean parse_colorspace( const char *arg, DFBSurfaceColorSpace *ret_colorspace )
 {
      int i = 0;
 
      while (colorspace_names[i].colorspace != DSCS_UNKNOWN) {
           if (!strcasecmp( arg, colorspace_names[i].name ) &&
               colorspace_names[i].colorspace != DSCS_RGB) {
-               colorspace = colorspace_names[i].colorspace;
+               *ret_colorspace = colorspace_names[i].colorspace;
                return DFB_TRUE;
           }
 
@@ -142,6 +248,151 @@ static DFBBoolean parse_colorspace( const char *arg )
      return DFB_FALSE;
 }
 
+static DFBBoolean parse_scale( const char *arg, int *ret_width, int *ret_height )
+{
+     if (sscanf( arg, "%dx%d", ret_width, ret_height ) == 2 && *ret_width > 0 && *ret_height > 0)
+          return DFB_TRUE;
+
+     fprintf( stderr, "Invalid scale specified!\n" );
+
+     return DFB_FALSE;
+}
+
+static DFBBoolean parse_quality( const char *arg )
+{
+     int i;
+
+     for (i = 0; i < D_ARRAY_SIZE(scaler_names); i++) {
+          if (!strcasecmp( arg, scaler_names[i].name )) {
+               scaler = scaler_names[i].flags;
+               return DFB_TRUE;
+          }
+     }
+
+     fprintf( stderr, "Invalid scaler specified!\n" );
+
+     return DFB_FALSE;
+}
+
+static DFBBoolean parse_fit( const char *arg )
+{
+     int i;
+
+     for (i = 0; i < D_ARRAY_SIZE(fit_names); i++) {
+          if (!strcasecmp( arg, fit_names[i] )) {
+               fit = i;
+               return DFB_TRUE;
+          }
+     }
+
+     fprintf( stderr, "Invalid fit mode specified!\n" );
+
+     return DFB_FALSE;
+}
+
+/*
+ * Parses an output variant given as comma separated key=value pairs.
+ */
+static DFBBoolean parse_variant( const char *arg )
+{
+     OutputSpec *spec;
+     char       *options;
+     char       *option;
+     char       *save;
+
+     if (num_variants == MAX_VARIANTS) {
+          fprintf( stderr, "Too many output variants!\n" );
+          return DFB_FALSE;
+     }
+
+     spec = &variants[num_variants];
+
+     /* Kept until exit, the file name points into it. */
+     options = strdup( arg );
+     if (!options)
+          return DFB_FALSE;
+
+     for (option = strtok_r( options, ",", &save ); option; option = strtok_r( NULL, ",", &save )) {
+          char *value = strchr( option, '=' );
+
+          if (!value) {
+               fprintf( stderr, "Invalid output variant option '%s'!\n", option );
+               return DFB_FALSE;
+          }
+
+          *value++ = 0;
+
+          if (!strcmp( option, "file" )) {
+               spec->filename = value;
+          }
+          else if (!strcmp( option, "format" )) {
+               if (!parse_format( value, &spec->format ))
+                    return DFB_FALSE;
+          }
+          else if (!strcmp( option, "scale" )) {
+               if (!parse_scale( value, &spec->width, &spec->height ))
+                    return DFB_FALSE;
+          }
+          else if (!strcmp( option, "colorspace" )) {
+               if (!parse_colorspace( value, &spec->colorspace ))
+                    return DFB_FALSE;
+          }
+          else {
+               fprintf( stderr, "Invalid output variant option '%s'!\n", option );
+               return DFB_FALSE;
+          }
+     }
+
+     if (!spec->filename) {
+          fprintf( stderr, "No file specified for output variant!\n" );
+          return DFB_FALSE;
+     }
+
+     num_variants++;
+
+     return DFB_TRUE;
+}
+
+static DFBBoolean parse_jobs( const char *arg )
+{
+     if (sscanf( arg, "%d", &jobs ) == 1 && jobs > 0 && jobs <= MAX_JOBS)
+          return DFB_TRUE;
+
+     fprintf( stderr, "Invalid number of jobs specified (1 to %d)!\n", MAX_JOBS );
+
+     return DFB_FALSE;
+}
+
+static DFBBoolean parse_alignment( const char *arg )
+{
+     if (!strcmp( arg, "page" ))
+          alignment = sysconf( _SC_PAGESIZE );
+     else if (sscanf( arg, "%u", &alignment ) != 1)
+          alignment = 0;
+
+     /* A power of two, up to 1 MB. */
+     if (alignment && !(alignment & (alignment - 1)) && alignment <= 0x100000)
+          return DFB_TRUE;
+
+     fprintf( stderr, "Invalid alignment specified!\n" );
+
+     return DFB_FALSE;
+}
+
+static DFBBoolean parse_time( const char *arg, int64_t *ret_time )
+{
+     int64_t time;
+
+     if (av_parse_time( &time, arg, 1 ) < 0 || time < 0) {
+          fprintf( stderr, "Invalid time '%s'!\n", arg );
+          return DFB_FALSE;
+     }
+
+     *ret_time = time;
+
+     return DFB_TRUE;
+}
+
 static DFBBoolean parse_command_line( int argc, char *argv[] )
 {
      int n;
@@ -165,7 +416,7 @@ static DFBBoolean parse_command_line( int argc, char *argv[] )
                     return DFB_FALSE;
                }
 
-               if (!parse_format( argv[n] ))
+               if (!parse_format( argv[n], &format ))
                     return DFB_FALSE;
 
                continue;
@@ -201,7 +452,7 @@ static DFBBoolean parse_command_line( int argc, char *argv[] )
                     return DFB_FALSE;
                }
 
-               if (!parse_colorspace( argv[n] ))
+               if (!parse_colorspace( argv[n], &colorspace ))
                     return DFB_FALSE;
 
                continue;
@@ -218,262 +469,2605 @@ static DFBBoolean parse_command_line( int argc, char *argv[] )
                continue;
           }
 
-          if (filename || access( arg, R_OK )) {
-               print_usage();
-               return DFB_FALSE;
-          }
-
-          filename = arg;
-     }
-
-     if (!filename) {
-          print_usage();
-          return DFB_FALSE;
-     }
+          if (strcmp( arg, "-t" ) == 0 || strcmp( arg, "--start" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-     return DFB_TRUE;
-}
+               if (!parse_time( argv[n], &start_time ))
+                    return DFB_FALSE;
 
-/**********************************************************************************************************************/
+               continue;
+          }
 
-static void *load_video( DFBSurfaceDescription *desc )
-{
-     DFBSurfacePixelFormat  dest_format;
-     int                    frame_size;
-     void                  *handle;
-     FILE                  *fp      = NULL;
-     AVFormatContext       *fmt_ctx = NULL;
-     unsigned char         *data    = NULL;
+          if (strcmp( arg, "-l" ) == 0 || strcmp( arg, "--duration" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-     desc->flags = DSDESC_NONE;
+               if (!parse_time( argv[n], &duration ))
+                    return DFB_FALSE;
 
-     if (width && height) {
-          if (!fps_num) {
-               fprintf( stderr, "Specifying the frame rate is also required!\n" );
-               goto out;
+               continue;
           }
 
-          if (!format) {
-               fprintf( stderr, "No format specified!\n" );
-               goto out;
-          }
+          if (strcmp( arg, "-o" ) == 0 || strcmp( arg, "--output" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-          fp = fopen( filename, "rb" );
-          if (!fp) {
-               fprintf( stderr, "Failed to open '%s'!\n", filename );
-               goto out;
+               output = argv[n];
+
+               continue;
           }
 
-          if (!colorspace)
-               colorspace = width >= 1280 || height > 576 ? DSCS_BT709 : DSCS_BT601;
+          if (strcmp( arg, "-O" ) == 0 || strcmp( arg, "--variant" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-          dest_format = format;
-          frame_size  = DFB_BYTES_PER_LINE( format, width ) * DFB_PLANE_MULTIPLY( format, height );
+               if (!parse_variant( argv[n] ))
+                    return DFB_FALSE;
 
-          data = malloc( frame_size );
-          if (!data) {
-               fprintf( stderr, "Failed to allocate %d bytes!\n", frame_size );
-               goto out;
+               continue;
           }
-          else {
-               if (!nframes) {
-                    struct stat st;
 
-                    if (stat( filename, &st ) < 0) {
-                         fprintf( stderr, "Failed to get file status!\n" );
-                         goto out;
-                    }
-
-                    nframes = st.st_size / frame_size;
+          if (strcmp( arg, "-S" ) == 0 || strcmp( arg, "--scale" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
                }
+
+               if (!parse_scale( argv[n], &out_width, &out_height ))
+                    return DFB_FALSE;
+
+               continue;
           }
 
-          handle = fp;
-     }
-     else {
-          DFBSurfacePixelFormat src_format;
+          if (strcmp( arg, "-q" ) == 0 || strcmp( arg, "--quality" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-          av_register_all();
+               if (!parse_quality( argv[n] ))
+                    return DFB_FALSE;
 
-          if (avformat_open_input( &fmt_ctx, filename, NULL, NULL ) < 0) {
-               fprintf( stderr, "Failed to open '%s'!\n", filename );
-               goto out;
+               continue;
           }
 
-          if (avformat_find_stream_info( fmt_ctx, NULL ) < 0) {
-               fprintf( stderr, "Couldn't find stream info!\n" );
-               goto out;
-          }
+          if (strcmp( arg, "-m" ) == 0 || strcmp( arg, "--fit" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-          width   = fmt_ctx->streams[0]->codec->width;
-          height  = fmt_ctx->streams[0]->codec->height;
-          fps_num = fmt_ctx->streams[0]->avg_frame_rate.num;
-          fps_den = fmt_ctx->streams[0]->avg_frame_rate.den;
+               if (!parse_fit( argv[n] ))
+                    return DFB_FALSE;
 
-          switch (fmt_ctx->streams[0]->codec->colorspace) {
-               case AVCOL_SPC_BT709:
-                    colorspace = DSCS_BT709;
-                    break;
-               case AVCOL_SPC_BT470BG:
-               case AVCOL_SPC_SMPTE170M:
-                    colorspace = DSCS_BT601;
-                    break;
-               case AVCOL_SPC_BT2020_NCL:
-                    colorspace = DSCS_BT2020;
-                    break;
-               default:
-                    colorspace = width >= 1280 || height > 576 ? DSCS_BT709 : DSCS_BT601;
-                    break;
+               continue;
           }
 
-          switch (fmt_ctx->streams[0]->codec->pix_fmt) {
-               case AV_PIX_FMT_YUV420P:
-                    src_format = DSPF_I420;
-                    break;
-               case AV_PIX_FMT_YUV422P:
-                    src_format = DSPF_Y42B;
-                    break;
-               case AV_PIX_FMT_YUV444P:
-                    src_format = DSPF_Y444;
-                    break;
-               default:
-                    fprintf( stderr, "Invalid pixel format!\n" );
-                    goto out;
-          }
+          if (strcmp( arg, "-j" ) == 0 || strcmp( arg, "--jobs" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-          dest_format = format ?: src_format;
-          frame_size = DFB_BYTES_PER_LINE( dest_format, width ) * DFB_PLANE_MULTIPLY( dest_format, height );
+               if (!parse_jobs( argv[n] ))
+                    return DFB_FALSE;
 
-          data = malloc( frame_size );
-          if (!data) {
-               fprintf( stderr, "Failed to allocate %d bytes!\n", frame_size );
-               goto out;
+               continue;
           }
-          else {
-               if (avcodec_open2( fmt_ctx->streams[0]->codec,
-                                  avcodec_find_decoder( fmt_ctx->streams[0]->codec->codec_id ), NULL)) {
-                    fprintf( stderr, "Failed to open video codec!\n" );
-                    goto out;
+
+          if (strcmp( arg, "-a" ) == 0 || strcmp( arg, "--align" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
                }
-          }
 
-          handle = fmt_ctx;
-     }
+               if (!parse_alignment( argv[n] ))
+                    return DFB_FALSE;
 
-     desc->flags                 = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT | DSDESC_PREALLOCATED |
-                                   DSDESC_COLORSPACE;
-     desc->width                 = width;
-     desc->height                = height;
-     desc->pixelformat           = dest_format;
-     desc->preallocated[0].data  = data;
-     desc->preallocated[0].pitch = DFB_BYTES_PER_LINE( format, width );
-     desc->colorspace            = colorspace;
+               continue;
+          }
 
-     fp      = NULL;
-     fmt_ctx = NULL;
-     data    = NULL;
+          if (strcmp( arg, "-p" ) == 0 || strcmp( arg, "--align-planes" ) == 0) {
+               align_planes = true;
+               continue;
+          }
 
-out:
-     if (data)
-          free( data );
+          if (strcmp( arg, "-z" ) == 0 || strcmp( arg, "--compress" ) == 0) {
+               compression = true;
+               continue;
+          }
 
-     if (fp)
-          fclose( fp );
+          if (strcmp( arg, "-k" ) == 0 || strcmp( arg, "--keyframes" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-     if (fmt_ctx)
-          avformat_close_input( &fmt_ctx );
+               if (sscanf( argv[n], "%u", &keyframe_interval ) != 1 || !keyframe_interval) {
+                    fprintf( stderr, "Invalid keyframe interval specified!\n" );
+                    return DFB_FALSE;
+               }
 
-     return desc->flags ? handle : NULL;
-}
+               continue;
+          }
 
-static void write_frames( void *handle, DFBSurfaceDescription *desc )
-{
-     int                frame_size;
-     unsigned long      frames_decoded;
-     FILE              *fp      = NULL;
-     AVFormatContext   *fmt_ctx = NULL;
-     struct SwsContext *sws_ctx = NULL;
-     AVFrame           *frame   = NULL;
+          if (strcmp( arg, "-b" ) == 0 || strcmp( arg, "--benchmark" ) == 0) {
+               benchmark = true;
+               continue;
+          }
 
-     frame_size = DFB_BYTES_PER_LINE( desc->pixelformat, width ) * DFB_PLANE_MULTIPLY( desc->pixelformat, height );
+          if (strcmp( arg, "-e" ) == 0 || strcmp( arg, "--elide" ) == 0) {
+               elide = true;
+               continue;
+          }
 
-     if (!avcodec_find_decoder_by_name( "h264" )) {
-          fp = handle;
+          if (strcmp( arg, "-E" ) == 0 || strcmp( arg, "--threshold" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
 
-          for (frames_decoded = 0; frames_decoded < nframes; frames_decoded++) {
-               if (fread( desc->preallocated[0].data, 1, frame_size, fp ) != frame_size) {
-                   fprintf( stderr, "Failed to read raw file!\n" );
-                   goto out;
+               if (sscanf( argv[n], "%u", &threshold ) != 1 || threshold > 255) {
+                    fprintf( stderr, "Invalid threshold specified (0 to 255)!\n" );
+                    return DFB_FALSE;
                }
 
-               fwrite( desc->preallocated[0].data, 1, frame_size, stdout );
+               continue;
           }
-     }
-     else {
-          enum AVPixelFormat  pix_fmt;
-          AVPicture           picture;
-          AVPacket            pkt;
-          int                 got_frame = 0;
 
-          fmt_ctx = handle;
+          if (strcmp( arg, "-B" ) == 0 || strcmp( arg, "--blend" ) == 0) {
+               blend = true;
+               continue;
+          }
+
+          /* Raw input video may also be read from the standard input. */
+          if (filename || (strcmp( arg, "-" ) && access( arg, R_OK ))) {
+               print_usage();
+               return DFB_FALSE;
+          }
+
+          filename = arg;
+     }
+
+     if (!filename) {
+          print_usage();
+          return DFB_FALSE;
+     }
+
+     if (align_planes && !alignment) {
+          fprintf( stderr, "Aligning planes requires an alignment!\n" );
+          return DFB_FALSE;
+     }
+
+     if (compression && (alignment || jobs > 1)) {
+          fprintf( stderr, "Compressed frames can neither be aligned nor decoded in parallel segments!\n" );
+          return DFB_FALSE;
+     }
+
+     if (benchmark && !compression) {
+          fprintf( stderr, "The benchmark requires compressed frames!\n" );
+          return DFB_FALSE;
+     }
+
+     if (threshold && !elide) {
+          fprintf( stderr, "A threshold requires eliding repeated frames!\n" );
+          return DFB_FALSE;
+     }
+
+     if (elide && jobs > 1) {
+          fprintf( stderr, "Repeated frames can not be elided in parallel segments!\n" );
+          return DFB_FALSE;
+     }
+
+     if (blend && !fps_num) {
+          fprintf( stderr, "Blending frames requires a frame rate to convert to!\n" );
+          return DFB_FALSE;
+     }
+
+     if (blend && jobs > 1) {
+          fprintf( stderr, "Frames can not be blended in parallel segments!\n" );
+          return DFB_FALSE;
+     }
+
+     return DFB_TRUE;
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * DirectFB YUV formats as FFmpeg pixel formats. Formats with swapped chroma are written in the FFmpeg format, with
+ * the chroma planes or the interleaved chroma samples swapped.
+ */
+
+typedef struct {
+     DFBSurfacePixelFormat  format;
+     enum AVPixelFormat     pix_fmt;
+     bool                   swap_uv;
+} FormatMapping;
+
+static const FormatMapping format_mappings[] = {
+     { DSPF_I420, AV_PIX_FMT_YUV420P, false },
+     { DSPF_YV12, AV_PIX_FMT_YUV420P, true  },
+     { DSPF_Y42B, AV_PIX_FMT_YUV422P, false },
+     { DSPF_YV16, AV_PIX_FMT_YUV422P, true  },
+     { DSPF_Y444, AV_PIX_FMT_YUV444P, false },
+     { DSPF_YV24, AV_PIX_FMT_YUV444P, true  },
+     { DSPF_NV12, AV_PIX_FMT_NV12,    false },
+     { DSPF_NV21, AV_PIX_FMT_NV21,    false },
+     { DSPF_NV16, AV_PIX_FMT_NV16,    false },
+     { DSPF_NV61, AV_PIX_FMT_NV16,    true  },
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(56, 31, 100)
+     { DSPF_NV24, AV_PIX_FMT_NV24,    false },
+     { DSPF_NV42, AV_PIX_FMT_NV42,    false },
+#endif
+     { DSPF_YUY2, AV_PIX_FMT_YUYV422, false },
+     { DSPF_UYVY, AV_PIX_FMT_UYVY422, false }
+};
+
+static const FormatMapping *lookup_format( DFBSurfacePixelFormat format )
+{
+     int i;
+
+     for (i = 0; i < D_ARRAY_SIZE(format_mappings); i++) {
+          if (format_mappings[i].format == format)
+               return &format_mappings[i];
+     }
+
+     return NULL;
+}
+
+static DFBSurfacePixelFormat lookup_pix_fmt( enum AVPixelFormat pix_fmt )
+{
+     int i;
+
+     for (i = 0; i < D_ARRAY_SIZE(format_mappings); i++) {
+          if (format_mappings[i].pix_fmt == pix_fmt && !format_mappings[i].swap_uv)
+               return format_mappings[i].format;
+     }
+
+     return DSPF_UNKNOWN;
+}
+
+/*
+ * Layout of the frames in the file. Planes follow each other, unless aligned, and frames are padded to the alignment.
+ */
+
+typedef struct {
+     int                     num_planes;
+     int                     plane_bytes[4];    /* bytes per line */
+     int                     plane_rows[4];
+     int                     plane_offset[4];   /* from the start of the frame */
+     int                     frame_size;        /* distance between frames, including padding */
+} FrameLayout;
+
+static void frame_layout( FrameLayout *layout, DFBSurfacePixelFormat format, int w, int h )
+{
+     const FormatMapping *mapping = lookup_format( format );
+     int                  i;
+     int                  offset  = 0;
+
+     memset( layout, 0, sizeof(FrameLayout) );
+
+     if (mapping) {
+          const AVPixFmtDescriptor *pix_desc = av_pix_fmt_desc_get( mapping->pix_fmt );
+
+          layout->num_planes = av_pix_fmt_count_planes( mapping->pix_fmt );
+
+          av_image_fill_linesizes( layout->plane_bytes, mapping->pix_fmt, w );
+
+          for (i = 0; i < layout->num_planes; i++)
+               layout->plane_rows[i] = i ? AV_CEIL_RSHIFT( h, pix_desc->log2_chroma_h ) : h;
+     }
+     else {
+          /* Other formats are laid out as a single plane. */
+          layout->num_planes     = 1;
+          layout->plane_bytes[0] = DFB_BYTES_PER_LINE( format, w );
+          layout->plane_rows[0]  = DFB_PLANE_MULTIPLY( format, h );
+     }
+
+     for (i = 0; i < layout->num_planes; i++) {
+          if (align_planes)
+               offset = ALIGN_UP( offset, alignment );
+
+          layout->plane_offset[i] = offset;
+
+          offset += layout->plane_bytes[i] * layout->plane_rows[i];
+     }
+
+     layout->frame_size = alignment ? ALIGN_UP( offset, alignment ) : offset;
+}
+
+/*
+ * Checks that the frame size is a multiple of the chroma subsampling, as for DirectFB surfaces. The planes of the
+ * layout then add up to the frame size given by DFB_BYTES_PER_LINE() and DFB_PLANE_MULTIPLY(), as read by players.
+ */
+static bool check_frame_size( DFBSurfacePixelFormat format, int w, int h )
+{
+     const FormatMapping      *mapping = lookup_format( format );
+     const AVPixFmtDescriptor *pix_desc;
+
+     if (!mapping)
+          return true;
+
+     pix_desc = av_pix_fmt_desc_get( mapping->pix_fmt );
+
+     return !(w & ((1 << pix_desc->log2_chroma_w) - 1)) && !(h & ((1 << pix_desc->log2_chroma_h) - 1));
+}
+
+/*
+ * Plane pointers of a frame in a buffer of the layout.
+ */
+static void frame_planes( const FrameLayout *layout, u8 *buffer, u8 *data[4], int linesize[4] )
+{
+     int i;
+
+     for (i = 0; i < 4; i++) {
+          data[i]     = i < layout->num_planes ? buffer + layout->plane_offset[i] : NULL;
+          linesize[i] = layout->plane_bytes[i];
+     }
+}
+
+/*
+ * Padding following a plane, up to the next plane or the next frame.
+ */
+static int plane_padding( const FrameLayout *layout, int plane )
+{
+     int end = plane + 1 < layout->num_planes ? layout->plane_offset[plane+1] : layout->frame_size;
+
+     return end - layout->plane_offset[plane] - layout->plane_bytes[plane] * layout->plane_rows[plane];
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Compressed frames (DFVFF_CODEC_RLE).
+ */
+
+static u8 *put_token( u8 *dst, u8 repeat, unsigned int length )
+{
+     if (length < 128) {
+          *dst++ = repeat | (length - 1);
+          return dst;
+     }
+
+     *dst++  = repeat | 127;
+     length -= 128;
+
+     while (length >= 0x80) {
+          *dst++   = 0x80 | (length & 0x7f);
+          length >>= 7;
+     }
+
+     *dst++ = length;
+
+     return dst;
+}
+
+/*
+ * Codes 'length' bytes as runs, returns the number of bytes written to 'dst' (at most RLE_BOUND( length )).
+ */
+static int rle_encode( const u8 *src, int length, u8 *dst )
+{
+     u8  *start   = dst;
+     int  literal = 0;
+     int  i       = 0;
+
+     while (i < length) {
+          int run = 1;
+
+          while (i + run < length && src[i+run] == src[i])
+               run++;
+
+          /* Short runs are left in literal runs. */
+          if (run >= MIN_RUN) {
+               if (literal < i) {
+                    dst = put_token( dst, 0x00, i - literal );
+
+                    memcpy( dst, src + literal, i - literal );
+
+                    dst += i - literal;
+               }
+
+               dst = put_token( dst, 0x80, run );
+
+               *dst++ = src[i];
+
+               literal = i + run;
+          }
+
+          i += run;
+     }
+
+     if (literal < length) {
+          dst = put_token( dst, 0x00, length - literal );
+
+          memcpy( dst, src + literal, length - literal );
+
+          dst += length - literal;
+     }
+
+     return dst - start;
+}
+
+/*
+ * Decodes runs to 'size' bytes, or adds them to the previous frame in 'dst' for a difference.
+ */
+static bool rle_decode( const u8 *src, int length, u8 *dst, int size, bool difference )
+{
+     const u8 *end = src + length;
+     int       pos = 0;
+     int       i;
+
+     while (src < end) {
+          u8           token = *src++;
+          unsigned int count = (token & 0x7f) + 1;
+
+          if (count == 128) {
+               unsigned int shift = 0;
+               unsigned int value;
+
+               do {
+                    if (src == end || shift > 21)
+                         return false;
+
+                    value  = *src++;
+                    count += (value & 0x7f) << shift;
+                    shift += 7;
+               } while (value & 0x80);
+          }
+
+          if (count > size - pos)
+               return false;
+
+          if (token & 0x80) {
+               if (src == end)
+                    return false;
+
+               if (!difference)
+                    memset( dst + pos, *src, count );
+               else if (*src) {
+                    for (i = 0; i < count; i++)
+                         dst[pos+i] += *src;
+               }
+
+               src++;
+          }
+          else {
+               if (count > end - src)
+                    return false;
+
+               if (!difference)
+                    memcpy( dst + pos, src, count );
+               else {
+                    for (i = 0; i < count; i++)
+                         dst[pos+i] += src[i];
+               }
+
+               src += count;
+          }
+
+          pos += count;
+     }
+
+     return pos == size;
+}
+
+/*
+ * Hashes bytes a word at a time, to compare frames with the previous one at the speed of memory.
+ */
+static u64 hash_bytes( u64 hash, const u8 *data, int length )
+{
+     int i;
+
+     for (i = 0; i + 8 <= length; i += 8) {
+          u64 word;
+
+          memcpy( &word, data + i, 8 );
+
+          hash  = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+          hash ^= hash >> 29;
+     }
+
+     for (; i < length; i++)
+          hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+     return hash;
+}
+
+/*
+ * Checks that no byte differs by more than the threshold, stopping at the first one.
+ */
+static bool within_threshold( const u8 *previous, const u8 *frame, int length )
+{
+     int i;
+
+     for (i = 0; i < length; i++) {
+          if (abs( frame[i] - previous[i] ) > (int) threshold)
+               return false;
+     }
+
+     return true;
+}
+
+/**********************************************************************************************************************/
+
+typedef struct {
+     FILE              *fp;           /* raw input video */
+     bool               streaming;    /* raw input video from a pipe, of unknown length */
+     AVFormatContext   *fmt_ctx;      /* demuxed input video */
+     AVCodecContext    *dec_ctx;
+     int                stream_index;
+} VideoInput;
+
+static void close_video( VideoInput *input )
+{
+     if (input->fp)
+          fclose( input->fp );
+
+     if (input->dec_ctx)
+          avcodec_free_context( &input->dec_ctx );
+
+     if (input->fmt_ctx)
+          avformat_close_input( &input->fmt_ctx );
+
+     memset( input, 0, sizeof(VideoInput) );
+}
+
+/* Number of raw input video frames within the time span (in AV_TIME_BASE units). */
+static unsigned long raw_frames( int64_t time )
+{
+     return av_rescale_q( time, AV_TIME_BASE_Q, (AVRational) { fps_den, fps_num } );
+}
+
+/*
+ * Opens the demuxer and the decoder of the video stream, each segment decoded in parallel has its own.
+ */
+static DFBResult open_decoder( VideoInput *input )
+{
+     AVStream      *stream;
+     const AVCodec *codec;
+
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+     av_register_all();
+#endif
+
+     if (avformat_open_input( &input->fmt_ctx, filename, NULL, NULL ) < 0) {
+          fprintf( stderr, "Failed to open '%s'!\n", filename );
+          return DFB_FAILURE;
+     }
+
+     if (avformat_find_stream_info( input->fmt_ctx, NULL ) < 0) {
+          fprintf( stderr, "Couldn't find stream info!\n" );
+          return DFB_FAILURE;
+     }
+
+     input->stream_index = av_find_best_stream( input->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0 );
+     if (input->stream_index < 0) {
+          fprintf( stderr, "Couldn't find a video stream!\n" );
+          return DFB_FAILURE;
+     }
+
+     stream = input->fmt_ctx->streams[input->stream_index];
+
+     codec = avcodec_find_decoder( stream->codecpar->codec_id );
+     if (!codec) {
+          fprintf( stderr, "Couldn't find a video decoder!\n" );
+          return DFB_FAILURE;
+     }
+
+     input->dec_ctx = avcodec_alloc_context3( codec );
+     if (!input->dec_ctx || avcodec_parameters_to_context( input->dec_ctx, stream->codecpar ) < 0) {
+          fprintf( stderr, "Failed to allocate video codec context!\n" );
+          return DFB_FAILURE;
+     }
+
+     /* Decode several frames or slices in parallel, with as many threads as CPUs shared by all segments. */
+     input->dec_ctx->thread_count = jobs > 1 ? MAX( sysconf( _SC_NPROCESSORS_ONLN ) / jobs, 1 ) : 0;
+     input->dec_ctx->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+     if (avcodec_open2( input->dec_ctx, codec, NULL )) {
+          fprintf( stderr, "Failed to open video codec!\n" );
+          return DFB_FAILURE;
+     }
+
+     DEBUG( "Decoding with %d thread(s) (%s threading)\n", input->dec_ctx->thread_count,
+            input->dec_ctx->active_thread_type & FF_THREAD_FRAME ? "frame" :
+            input->dec_ctx->active_thread_type & FF_THREAD_SLICE ? "slice" : "no" );
+
+     return DFB_OK;
+}
+
+static DFBResult load_video( VideoInput *input, DFBSurfaceDescription *desc )
+{
+     DFBSurfacePixelFormat  dest_format;
+     int                    dest_width;
+     int                    dest_height;
+     int                    frame_size;
+     unsigned char         *data = NULL;
+
+     memset( input, 0, sizeof(VideoInput) );
+
+     desc->flags = DSDESC_NONE;
+
+     if (width && height) {
+          if (!fps_num) {
+               fprintf( stderr, "Specifying the frame rate is also required!\n" );
+               goto out;
+          }
+
+          if (!format) {
+               fprintf( stderr, "No format specified!\n" );
+               goto out;
+          }
+
+          if (out_width) {
+               fprintf( stderr, "Scaling is only supported for decoded input video!\n" );
+               goto out;
+          }
+
+          if (blend) {
+               fprintf( stderr, "Blending frames is only supported for decoded input video!\n" );
+               goto out;
+          }
+
+          input->fp = strcmp( filename, "-" ) ? fopen( filename, "rb" ) : stdin;
+          if (!input->fp) {
+               fprintf( stderr, "Failed to open '%s'!\n", filename );
+               goto out;
+          }
+
+          if (!colorspace)
+               colorspace = width >= 1280 || height > 576 ? DSCS_BT709 : DSCS_BT601;
+
+          dest_format = format;
+          dest_width  = width;
+          dest_height = height;
+          frame_size  = DFB_BYTES_PER_LINE( format, width ) * DFB_PLANE_MULTIPLY( format, height );
+
+          data = malloc( frame_size );
+          if (!data) {
+               fprintf( stderr, "Failed to allocate %d bytes!\n", frame_size );
+               goto out;
+          }
+          else {
+               unsigned long first_frame = raw_frames( start_time );
+               struct stat   st;
+
+               if (fstat( fileno( input->fp ), &st ) < 0) {
+                    fprintf( stderr, "Failed to get file status!\n" );
+                    goto out;
+               }
+
+               /* Frames are read from pipes until the end, unless limited. */
+               input->streaming = !S_ISREG( st.st_mode );
+
+               if (!nframes && !input->streaming) {
+                    nframes = st.st_size / frame_size;
+                    nframes = nframes > first_frame ? nframes - first_frame : 0;
+               }
+
+               if (duration)
+                    nframes = input->streaming && !nframes ? raw_frames( duration ) :
+                                                             MIN( nframes, raw_frames( duration ) );
+          }
+     }
+     else {
+          DFBSurfacePixelFormat  src_format;
+          AVStream              *stream;
+
+          if (!strcmp( filename, "-" )) {
+               fprintf( stderr, "Only raw input video can be read from the standard input!\n" );
+               goto out;
+          }
+
+          if (open_decoder( input ))
+               goto out;
+
+          stream = input->fmt_ctx->streams[input->stream_index];
+
+          width  = stream->codecpar->width;
+          height = stream->codecpar->height;
+
+          /* Decoded frames are dropped or repeated to the frame rate given, if any. */
+          if (fps_num) {
+               DEBUG( "Converting from %d/%d to %u/%u fps\n",
+                      stream->avg_frame_rate.num, stream->avg_frame_rate.den, fps_num, fps_den );
+
+               convert_rate = true;
+          }
+          else {
+               fps_num = stream->avg_frame_rate.num;
+               fps_den = stream->avg_frame_rate.den;
+          }
+
+          switch (stream->codecpar->color_space) {
+               case AVCOL_SPC_BT709:
+                    colorspace = DSCS_BT709;
+                    break;
+               case AVCOL_SPC_BT470BG:
+               case AVCOL_SPC_SMPTE170M:
+                    colorspace = DSCS_BT601;
+                    break;
+               case AVCOL_SPC_BT2020_NCL:
+                    colorspace = DSCS_BT2020;
+                    break;
+               default:
+                    colorspace = width >= 1280 || height > 576 ? DSCS_BT709 : DSCS_BT601;
+                    break;
+          }
+
+          /* Other decoder formats are converted to I420 by default. */
+          src_format = lookup_pix_fmt( stream->codecpar->format ) ?: DSPF_I420;
+
+          dest_format = format ?: src_format;
+          dest_width  = out_width  ?: width;
+          dest_height = out_height ?: height;
+          frame_size  = DFB_BYTES_PER_LINE( dest_format, dest_width ) * DFB_PLANE_MULTIPLY( dest_format, dest_height );
+
+          data = malloc( frame_size );
+          if (!data) {
+               fprintf( stderr, "Failed to allocate %d bytes!\n", frame_size );
+               goto out;
+          }
+     }
+
+     desc->flags                 = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT | DSDESC_PREALLOCATED |
+                                   DSDESC_COLORSPACE;
+     desc->width                 = dest_width;
+     desc->height                = dest_height;
+     desc->pixelformat           = dest_format;
+     desc->preallocated[0].data  = data;
+     desc->preallocated[0].pitch = DFB_BYTES_PER_LINE( dest_format, dest_width );
+     desc->colorspace            = colorspace;
+
+     data = NULL;
+
+out:
+     if (data)
+          free( data );
+
+     if (!desc->flags)
+          close_video( input );
+
+     return desc->flags ? DFB_OK : DFB_FAILURE;
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Decoding pipeline.
+ *
+ * Decoding, conversion and writing run in their own thread, connected by bounded rings of frames. Each stage takes
+ * an empty frame from a ring of free frames and passes it on through a ring of filled frames, so that a stage only
+ * waits when the next one is RING_SIZE frames behind. Each decoded frame is passed to the conversion stages of all
+ * outputs and returned to the decoder once the last one is done with it.
+ */
+
+typedef struct {
+     pthread_mutex_t  lock;
+     pthread_cond_t   cond;
+     void            *slots[RING_SIZE];
+     int              head;
+     int              count;
+     bool             closed;
+} FrameRing;
+
+static void ring_init( FrameRing *ring )
+{
+     memset( ring, 0, sizeof(FrameRing) );
+
+     pthread_mutex_init( &ring->lock, NULL );
+     pthread_cond_init( &ring->cond, NULL );
+}
+
+static void ring_deinit( FrameRing *ring )
+{
+     pthread_cond_destroy( &ring->cond );
+     pthread_mutex_destroy( &ring->lock );
+}
+
+static bool ring_push( FrameRing *ring, void *item )
+{
+     bool ret = false;
+
+     pthread_mutex_lock( &ring->lock );
+
+     while (ring->count == RING_SIZE && !ring->closed)
+          pthread_cond_wait( &ring->cond, &ring->lock );
+
+     if (!ring->closed) {
+          ring->slots[(ring->head + ring->count) % RING_SIZE] = item;
+          ring->count++;
+
+          pthread_cond_broadcast( &ring->cond );
+
+          ret = true;
+     }
+
+     pthread_mutex_unlock( &ring->lock );
+
+     return ret;
+}
+
+/*
+ * Returns NULL once the ring is closed and empty, or if empty without waiting.
+ */
+static void *ring_get( FrameRing *ring, bool wait )
+{
+     void *item = NULL;
+
+     pthread_mutex_lock( &ring->lock );
+
+     while (wait && !ring->count && !ring->closed)
+          pthread_cond_wait( &ring->cond, &ring->lock );
+
+     if (ring->count) {
+          item = ring->slots[ring->head];
+
+          ring->head = (ring->head + 1) % RING_SIZE;
+          ring->count--;
+
+          pthread_cond_broadcast( &ring->cond );
+     }
+
+     pthread_mutex_unlock( &ring->lock );
+
+     return item;
+}
+
+static void *ring_pop( FrameRing *ring )
+{
+     return ring_get( ring, true );
+}
+
+static void ring_close( FrameRing *ring )
+{
+     pthread_mutex_lock( &ring->lock );
+
+     ring->closed = true;
+
+     pthread_cond_broadcast( &ring->cond );
+
+     pthread_mutex_unlock( &ring->lock );
+}
+
+typedef struct {
+     AVFrame            *frame;
+     int                 users;         /* outputs still using the frame */
+} DecodedFrame;
+
+typedef struct _Pipeline Pipeline;
+
+#ifdef HAVE_LIBURING
+typedef struct {
+     u8                 *buffer;        /* NULL if not in flight */
+     off_t               offset;
+} WriteRequest;
+#endif
+
+/*
+ * Output stages, each one with its own conversion and writer thread.
+ */
+typedef struct {
+     Pipeline               *pipeline;
+
+     const char             *filename;      /* standard output if NULL */
+     int                     fd;
+     bool                    seekable;      /* otherwise extension headers are completed by a trailer */
+     bool                    positioned;    /* frames are written at 'offset' instead of the file position */
+     off_t                   offset;
+     DFBSurfacePixelFormat   format;
+
+     struct SwsContext      *sws_ctx;
+     enum AVPixelFormat      pix_fmt;
+     int                     width;
+     int                     height;
+     DFBSurfaceColorSpace    colorspace;
+     FrameLayout             layout;
+     u8                     *padding;       /* zeros for the padding of frames and planes */
+
+     DFVFFFrameEntry        *index;         /* compressed frames */
+     unsigned long           num_frames;
+     unsigned long           max_frames;
+     u64                     position;      /* file offset of the next compressed frame, or of the first frame */
+     u8                     *previous;      /* previous frame, for the difference or the comparison */
+     u8                     *difference;
+     u8                     *packed;
+     unsigned long           last_key;
+
+     bool                    repeat_table;  /* elided frames in a repeat table, not in the frame index */
+     u64                     hash;          /* last stored frame */
+     unsigned long           num_stored;
+     unsigned long           num_repeated;
+     DFVFFRepeatEntry       *repeats;
+     unsigned long           num_repeats;
+     unsigned long           max_repeats;
+
+     DFBRectangle            src_rect;      /* area of the decoded frames to scale */
+     DFBRectangle            dst_rect;      /* area of the output frames to scale to */
+
+     FrameRing               decoded;       /* DecodedFrame */
+     FrameRing               free_buffers;  /* frame_size bytes of the layout */
+     FrameRing               converted;     /* frame_size bytes of the layout */
+     u8                     *buffers[RING_SIZE];
+
+     bool                    swap_uv;
+
+     bool                    passthrough;   /* decoded frames are written as is, without conversion stage */
+     struct iovec           *iov;
+
+#ifdef HAVE_LIBURING
+     struct io_uring         uring;         /* converted frames are written asynchronously, at 'offset' */
+     bool                    uring_ready;
+     WriteRequest            requests[RING_SIZE];
+#endif
+
+     pthread_t               converter;
+     pthread_t               writer;
+     bool                    converter_started;
+     bool                    writer_started;
+} Output;
+
+struct _Pipeline {
+     pthread_mutex_t     lock;
+
+     FrameRing           free_frames;   /* DecodedFrame */
+     DecodedFrame        frames[RING_SIZE];
+
+     Output             *outputs;
+     int                 num_outputs;
+
+     int64_t             start_pts;     /* frames before are skipped */
+     int64_t             end_pts;       /* AV_NOPTS_VALUE if unlimited */
+     unsigned long       skipped;
+     unsigned long       max_frames;    /* frames of the segment, 0 if unlimited */
+
+     bool                convert_rate;  /* frames are dropped or repeated to the output frame rate */
+     bool                blend;         /* dropped frames are blended into the next one */
+     AVStream           *stream;
+     int64_t             next_slot;     /* index of the next output frame */
+     int64_t             end_slot;      /* INT64_MAX if unlimited */
+     DecodedFrame       *held;          /* last frame, passed on once the next one is decoded */
+     int64_t             held_pts;
+     int64_t             interval;      /* between the last two frames, 0 if unknown */
+     int                 blended;       /* frames blended into the held one */
+     unsigned long       dropped;
+     unsigned long       repeated;
+
+     bool                failed;
+};
+
+/* Stops all stages, filled frames not yet consumed are dropped. */
+static void pipeline_abort( Pipeline *pipeline )
+{
+     int i;
+
+     pipeline->failed = true;
+
+     ring_close( &pipeline->free_frames );
+
+     for (i = 0; i < pipeline->num_outputs; i++) {
+          ring_close( &pipeline->outputs[i].decoded );
+          ring_close( &pipeline->outputs[i].free_buffers );
+          ring_close( &pipeline->outputs[i].converted );
+     }
+}
+
+/*
+ * Returns a decoded frame to the decoder once all outputs are done with it.
+ */
+static void release_frame( Pipeline *pipeline, DecodedFrame *decoded )
+{
+     bool last;
+
+     pthread_mutex_lock( &pipeline->lock );
+
+     last = !--decoded->users;
+
+     pthread_mutex_unlock( &pipeline->lock );
+
+     if (last) {
+          av_frame_unref( decoded->frame );
+
+          ring_push( &pipeline->free_frames, decoded );
+     }
+}
+
+/*
+ * Computes the area of the decoded frames scaled to an area of the output frames, keeping the display aspect ratio
+ * when letterboxing or cropping. Positions and sizes are aligned to the chroma subsampling.
+ */
+static void fit_frames( Output *out, const AVCodecContext *dec_ctx )
+{
+     const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get( dec_ctx->pix_fmt );
+     const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get( out->pix_fmt );
+     AVRational                sar      = dec_ctx->sample_aspect_ratio;
+     DFBRectangle             *src      = &out->src_rect;
+     DFBRectangle             *dst      = &out->dst_rect;
+     s64                       display_width, display_height;
+
+     src->x = src->y = 0;
+     src->w = width;
+     src->h = height;
+
+     dst->x = dst->y = 0;
+     dst->w = out->width;
+     dst->h = out->height;
+
+     if (fit == FIT_STRETCH)
+          return;
+
+     if (sar.num <= 0 || sar.den <= 0)
+          sar = (AVRational) { 1, 1 };
+
+     display_width  = (s64) width  * sar.num;
+     display_height = (s64) height * sar.den;
+
+     if (fit == FIT_LETTERBOX) {
+          if (display_width * dst->h > display_height * dst->w)
+               dst->h = dst->w * display_height / display_width;
+          else
+               dst->w = dst->h * display_width / display_height;
+
+          dst->w = MAX( ALIGN_DOWN( dst->w, dst_desc->log2_chroma_w ), 1 << dst_desc->log2_chroma_w );
+          dst->h = MAX( ALIGN_DOWN( dst->h, dst_desc->log2_chroma_h ), 1 << dst_desc->log2_chroma_h );
+          dst->x = ALIGN_DOWN( (out->width  - dst->w) / 2, dst_desc->log2_chroma_w );
+          dst->y = ALIGN_DOWN( (out->height - dst->h) / 2, dst_desc->log2_chroma_h );
+     }
+     else {
+          if (display_width * dst->h > display_height * dst->w)
+               src->w = width * dst->w * display_height / (dst->h * display_width);
+          else
+               src->h = height * dst->h * display_width / (dst->w * display_height);
+
+          src->w = MAX( ALIGN_DOWN( src->w, src_desc->log2_chroma_w ), 1 << src_desc->log2_chroma_w );
+          src->h = MAX( ALIGN_DOWN( src->h, src_desc->log2_chroma_h ), 1 << src_desc->log2_chroma_h );
+          src->x = ALIGN_DOWN( (width  - src->w) / 2, src_desc->log2_chroma_w );
+          src->y = ALIGN_DOWN( (height - src->h) / 2, src_desc->log2_chroma_h );
+     }
+}
+
+/*
+ * Offsets the planes of an image to a position aligned to the chroma subsampling.
+ */
+static void offset_planes( u8 *data[4], const int linesize[4], enum AVPixelFormat pix_fmt, int x, int y )
+{
+     const AVPixFmtDescriptor *pix_desc = av_pix_fmt_desc_get( pix_fmt );
+     int                       i;
+     bool                      done[4]  = { false };
+
+     for (i = 0; i < pix_desc->nb_components; i++) {
+          const AVComponentDescriptor *comp   = &pix_desc->comp[i];
+          bool                         chroma = i == 1 || i == 2;
+
+          /* Components sharing a plane are offset once. */
+          if (done[comp->plane])
+               continue;
+
+          data[comp->plane] += (chroma ? y >> pix_desc->log2_chroma_h : y) * linesize[comp->plane] +
+                               (chroma ? x >> pix_desc->log2_chroma_w : x) * comp->step;
+
+          done[comp->plane] = true;
+     }
+}
+
+static void swap_chroma_samples( u8 *data, int linesize, int rows )
+{
+     int x, y;
+
+     for (y = 0; y < rows; y++, data += linesize) {
+          for (x = 0; x < linesize - 1; x += 2) {
+               u8 u = data[x];
+
+               data[x]   = data[x+1];
+               data[x+1] = u;
+          }
+     }
+}
+
+static void *convert_thread( void *arg )
+{
+     Output       *out = arg;
+     DecodedFrame *decoded;
+
+     while ((decoded = ring_pop( &out->decoded ))) {
+          AVFrame *frame  = decoded->frame;
+          u8      *buffer = ring_pop( &out->free_buffers );
+          u8      *src[4];
+          u8      *dst[4];
+          u8      *data[4];
+          int      linesize[4];
+
+          if (!buffer) {
+               release_frame( out->pipeline, decoded );
+               break;
+          }
+
+          frame_planes( &out->layout, buffer, data, linesize );
+
+          if (out->swap_uv && out->layout.num_planes == 3) {
+               u8 *u = data[1];
+
+               data[1] = data[2];
+               data[2] = u;
+          }
+
+          memcpy( src, frame->data, sizeof(src) );
+          memcpy( dst, data, sizeof(dst) );
+
+          offset_planes( src, frame->linesize, frame->format, out->src_rect.x, out->src_rect.y );
+          offset_planes( dst, linesize, out->pix_fmt, out->dst_rect.x, out->dst_rect.y );
+
+          sws_scale( out->sws_ctx, (const u8* const*) src, frame->linesize, 0, out->src_rect.h, dst, linesize );
+
+          if (out->swap_uv && out->layout.num_planes == 2)
+               swap_chroma_samples( data[1], linesize[1], out->layout.plane_rows[1] );
+
+          release_frame( out->pipeline, decoded );
+
+          if (!ring_push( &out->converted, buffer ))
+               break;
+     }
+
+     ring_close( &out->converted );
+
+     return NULL;
+}
+
+/*
+ * Writes all vectors at the current file position, or at the given offset which is then advanced.
+ */
+static bool write_iov( int fd, off_t *offset, struct iovec *iov, int count )
+{
+     while (count > 0) {
+          ssize_t ret = offset ? pwritev( fd, iov, MIN( count, IOV_MAX ), *offset ) :
+                                 writev( fd, iov, MIN( count, IOV_MAX ) );
+
+          if (ret < 0) {
+               if (errno == EINTR)
+                    continue;
+
+               return false;
+          }
+
+          if (offset)
+               *offset += ret;
+
+          /* Skip what has been written, possibly within a vector. */
+          while (count > 0 && ret >= iov->iov_len) {
+               ret -= iov->iov_len;
+               iov++;
+               count--;
+          }
+
+          if (count > 0) {
+               iov->iov_base  = (u8*) iov->iov_base + ret;
+               iov->iov_len  -= ret;
+          }
+     }
+
+     return true;
+}
+
+/*
+ * Writes the planes of a decoded frame, with one vector per plane if its lines are contiguous, otherwise one per line,
+ * followed by the padding of each plane.
+ */
+static bool write_planes( Output *out, const AVFrame *frame )
+{
+     const FrameLayout *layout = &out->layout;
+     int                i, y;
+     int                count  = 0;
+
+     for (i = 0; i < layout->num_planes; i++) {
+          /* Swapped chroma planes are written in reverse order. */
+          int plane   = out->swap_uv && i ? 3 - i : i;
+          int padding = plane_padding( layout, i );
+
+          if (frame->linesize[plane] == layout->plane_bytes[plane]) {
+               out->iov[count].iov_base = frame->data[plane];
+               out->iov[count].iov_len  = layout->plane_bytes[plane] * layout->plane_rows[plane];
+               count++;
+          }
+          else {
+               for (y = 0; y < layout->plane_rows[plane]; y++) {
+                    out->iov[count].iov_base = frame->data[plane] + y * frame->linesize[plane];
+                    out->iov[count].iov_len  = layout->plane_bytes[plane];
+                    count++;
+               }
+          }
+
+          if (padding) {
+               out->iov[count].iov_base = out->padding;
+               out->iov[count].iov_len  = padding;
+               count++;
+          }
+     }
+
+     return write_iov( out->fd, out->positioned ? &out->offset : NULL, out->iov, count );
+}
+
+static DFVFFFrameEntry *add_index_entry( Output *out )
+{
+     if (out->num_frames == out->max_frames) {
+          unsigned long    max_frames = out->max_frames ? out->max_frames * 2 : 1024;
+          DFVFFFrameEntry *index      = realloc( out->index, max_frames * sizeof(DFVFFFrameEntry) );
+
+          if (!index)
+               return NULL;
+
+          out->index      = index;
+          out->max_frames = max_frames;
+     }
+
+     return &out->index[out->num_frames++];
+}
+
+/*
+ * Compresses a frame as a keyframe or as the difference with the previous one, and adds it to the index.
+ */
+static bool write_compressed( Output *out, const u8 *frame )
+{
+     int              i;
+     int              size;
+     bool             key = !out->num_frames || out->num_frames - out->last_key >= keyframe_interval;
+     DFVFFFrameEntry *entry;
+     struct iovec     iov;
+
+     if (key)
+          out->last_key = out->num_frames;
+
+     entry = add_index_entry( out );
+     if (!entry)
+          return false;
+
+     if (key)
+          size = rle_encode( frame, out->layout.frame_size, out->packed );
+     else {
+          for (i = 0; i < out->layout.frame_size; i++)
+               out->difference[i] = frame[i] - out->previous[i];
+
+          size = rle_encode( out->difference, out->layout.frame_size, out->packed );
+     }
+
+     memcpy( out->previous, frame, out->layout.frame_size );
+
+     entry->offset = out->position;
+     entry->size   = size;
+     entry->flags  = key ? DFVFF_FRAME_KEY : 0;
+
+     iov.iov_base = out->packed;
+     iov.iov_len  = size;
+
+     if (!write_iov( out->fd, NULL, &iov, 1 ))
+          return false;
+
+     out->position += size;
+
+     return true;
+}
+
+/*
+ * Checks whether a frame repeats the last stored one, identically or within the threshold, and records the repeat
+ * instead of the frame. Identical frames are found by their hash, confirmed against the copy of the previous frame.
+ */
+static bool elide_frame( Output *out, const u8 *frame, int length, u64 hash, bool *ret_repeat )
+{
+     DFVFFFrameEntry *entry;
+
+     *ret_repeat = false;
+
+     if (!out->num_stored || (threshold ? !within_threshold( out->previous, frame, length ) :
+                                          hash != out->hash || memcmp( out->previous, frame, length ))) {
+          out->hash = hash;
+          out->num_stored++;
+
+          /* Compressed frames keep the previous one for the difference. */
+          if (!compression)
+               memcpy( out->previous, frame, length );
+
+          return true;
+     }
+
+     *ret_repeat = true;
+
+     out->num_repeated++;
+
+     if (!out->repeat_table) {
+          entry = add_index_entry( out );
+          if (!entry)
+               return false;
+
+          entry->offset = out->position;
+          entry->size   = 0;
+          entry->flags  = DFVFF_FRAME_REPEAT;
+
+          return true;
+     }
+
+     /* Consecutive repeats of a stored frame share an entry. */
+     if (out->num_repeats && out->repeats[out->num_repeats-1].frame == out->num_stored - 1) {
+          out->repeats[out->num_repeats-1].count++;
+          return true;
+     }
+
+     if (out->num_repeats == out->max_repeats) {
+          unsigned long     max_repeats = out->max_repeats ? out->max_repeats * 2 : 256;
+          DFVFFRepeatEntry *repeats     = realloc( out->repeats, max_repeats * sizeof(DFVFFRepeatEntry) );
+
+          if (!repeats)
+               return false;
+
+          out->repeats     = repeats;
+          out->max_repeats = max_repeats;
+     }
+
+     out->repeats[out->num_repeats].frame = out->num_stored - 1;
+     out->repeats[out->num_repeats].count = 1;
+     out->num_repeats++;
+
+     return true;
+}
+
+static void *passthrough_thread( void *arg )
+{
+     Output       *out = arg;
+     DecodedFrame *decoded;
+
+     while ((decoded = ring_pop( &out->decoded ))) {
+          bool written = write_planes( out, decoded->frame );
+
+          release_frame( out->pipeline, decoded );
+
+          if (!written) {
+               fprintf( stderr, "Failed to write frame!\n" );
+               pipeline_abort( out->pipeline );
+               break;
+          }
+     }
+
+     return NULL;
+}
+
+/*
+ * Checks whether a converted frame repeats the last stored one.
+ */
+static bool elide_converted( Output *out, const u8 *buffer, bool *ret_repeat )
+{
+     u64 hash = threshold ? 0 : hash_bytes( HASH_SEED, buffer, out->layout.frame_size );
+
+     return elide_frame( out, buffer, out->layout.frame_size, hash, ret_repeat );
+}
+
+static void *write_thread( void *arg )
+{
+     Output *out = arg;
+     u8     *buffer;
+
+     while ((buffer = ring_pop( &out->converted ))) {
+          struct iovec iov     = { buffer, out->layout.frame_size };
+          bool         repeat  = false;
+          bool         written = true;
+
+          if (elide)
+               written = elide_converted( out, buffer, &repeat );
+
+          if (written && !repeat)
+               written = compression ? write_compressed( out, buffer ) :
+                                       write_iov( out->fd, out->positioned ? &out->offset : NULL, &iov, 1 );
+
+          if (!written) {
+               fprintf( stderr, "Failed to write frame!\n" );
+               pipeline_abort( out->pipeline );
+               break;
+          }
+
+          if (!ring_push( &out->free_buffers, buffer ))
+               break;
+     }
+
+     return NULL;
+}
+
+#ifdef HAVE_LIBURING
+/*
+ * Completes the write of a frame, writing the rest of a short write synchronously, and returns its buffer.
+ */
+static u8 *complete_write( Output *out, struct io_uring_cqe *cqe, bool *failed )
+{
+     WriteRequest *request = io_uring_cqe_get_data( cqe );
+     u8           *buffer  = request->buffer;
+     int           written = cqe->res;
+
+     io_uring_cqe_seen( &out->uring, cqe );
+
+     request->buffer = NULL;
+
+     if (written >= 0 && written < out->layout.frame_size) {
+          struct iovec iov    = { buffer + written, out->layout.frame_size - written };
+          off_t        offset = request->offset + written;
+
+          if (write_iov( out->fd, &offset, &iov, 1 ))
+               written = out->layout.frame_size;
+     }
+
+     if (written != out->layout.frame_size)
+          *failed = true;
+
+     return buffer;
+}
+
+/*
+ * Writes converted frames at their offset through io_uring, with up to RING_SIZE frames in flight. All frames
+ * available are submitted at once, completions are only waited for when no other frame is available, so that the
+ * conversion stage gets its buffers back as soon as possible.
+ */
+static void *uring_write_thread( void *arg )
+{
+     Output              *out       = arg;
+     struct io_uring_sqe *sqe;
+     struct io_uring_cqe *cqe       = NULL;
+     u8                  *buffer;
+     int                  i;
+     int                  ret;
+     int                  in_flight = 0;
+     bool                 closed    = false;
+     bool                 failed    = false;
+     bool                 aborted   = false;
+
+     while (!closed || in_flight) {
+          int queued = 0;
+
+          while (!closed && !failed) {
+               bool repeat = false;
+
+               /* Only wait for a frame if none is in flight. */
+               buffer = ring_get( &out->converted, !in_flight && !queued );
+               if (!buffer) {
+                    closed = !in_flight && !queued;
+                    break;
+               }
+
+               if (elide && !elide_converted( out, buffer, &repeat ))
+                    failed = true;
+
+               if (repeat || failed) {
+                    if (!ring_push( &out->free_buffers, buffer ))
+                         closed = true;
+
+                    continue;
+               }
+
+               /* There are as many requests as buffers. */
+               for (i = 0; out->requests[i].buffer; i++);
+
+               out->requests[i].buffer = buffer;
+               out->requests[i].offset = out->offset;
+
+               sqe = io_uring_get_sqe( &out->uring );
+
+               io_uring_prep_write( sqe, out->fd, buffer, out->layout.frame_size, out->offset );
+               io_uring_sqe_set_data( sqe, &out->requests[i] );
+
+               out->offset += out->layout.frame_size;
+               queued++;
+          }
+
+          if (queued) {
+               ret = io_uring_submit( &out->uring );
+
+               /* Frames submitted are still reaped before returning, the kernel writing from their buffers. */
+               if (ret > 0)
+                    in_flight += ret;
+
+               if (ret < queued) {
+                    fprintf( stderr, "Failed to submit frames (%s)!\n", strerror( ret < 0 ? -ret : EAGAIN ) );
+                    pipeline_abort( out->pipeline );
+                    closed  = true;
+                    failed  = true;
+                    aborted = true;
+               }
+          }
+
+          if (in_flight) {
+               while ((ret = io_uring_wait_cqe( &out->uring, &cqe )) == -EINTR);
+
+               if (ret < 0) {
+                    fprintf( stderr, "Failed to wait for written frames (%s)!\n", strerror( -ret ) );
+                    pipeline_abort( out->pipeline );
+                    break;
+               }
+
+               /* Reap all completed writes. */
+               do {
+                    buffer = complete_write( out, cqe, &failed );
+                    in_flight--;
+
+                    if (!failed && !ring_push( &out->free_buffers, buffer ))
+                         closed = true;
+               } while (in_flight && !io_uring_peek_cqe( &out->uring, &cqe ));
+          }
+
+          /* Frames in flight are still reaped before returning. */
+          if (failed && !aborted) {
+               fprintf( stderr, "Failed to write frame!\n" );
+               pipeline_abort( out->pipeline );
+               closed  = true;
+               aborted = true;
+          }
+     }
+
+     /* Following writes continue after the frames. */
+     if (!out->positioned)
+          lseek( out->fd, out->offset, SEEK_SET );
+
+     return NULL;
+}
+#endif
+
+/*
+ * Returns the YUV coefficients of the scaler for a color space.
+ */
+static const int *colorspace_coefficients( DFBSurfaceColorSpace colorspace )
+{
+     switch (colorspace) {
+          case DSCS_BT709:
+               return sws_getCoefficients( SWS_CS_ITU709 );
+          case DSCS_BT2020:
+               return sws_getCoefficients( SWS_CS_BT2020 );
+          default:
+               return sws_getCoefficients( SWS_CS_ITU601 );
+     }
+}
+
+static DFBResult output_init( Output *out, Pipeline *pipeline, const AVCodecContext *dec_ctx )
+{
+     int                        i;
+     int                        num_rows = 0;
+     bool                       scaled;
+     const FormatMapping       *mapping;
+#ifdef HAVE_LIBURING
+     struct stat                st;
+#endif
+
+     out->pipeline = pipeline;
+
+     ring_init( &out->decoded );
+     ring_init( &out->free_buffers );
+     ring_init( &out->converted );
+
+     mapping = lookup_format( out->format );
+     if (!mapping) {
+          fprintf( stderr, "Unsupported format conversion!\n" );
+          return DFB_UNSUPPORTED;
+     }
+
+     out->pix_fmt = mapping->pix_fmt;
+     out->swap_uv = mapping->swap_uv;
+
+     for (i = 0; i < out->layout.num_planes; i++)
+          num_rows += out->layout.plane_rows[i];
+
+     fit_frames( out, dec_ctx );
+
+     scaled = out->width      != width      || out->height     != height ||
+              out->src_rect.w != width      || out->src_rect.h != height ||
+              out->dst_rect.w != out->width || out->dst_rect.h != out->height;
+
+     if (scaled)
+          DEBUG( "Scaling %dx%d at %d,%d to %dx%d at %d,%d\n",
+                 out->src_rect.w, out->src_rect.h, out->src_rect.x, out->src_rect.y,
+                 out->dst_rect.w, out->dst_rect.h, out->dst_rect.x, out->dst_rect.y );
+
+     /* Without conversion to do, the decoded planes are written directly, unless compared or compressed as a whole. */
+     if (!scaled && dec_ctx->pix_fmt == out->pix_fmt && !(out->swap_uv && out->layout.num_planes == 2) &&
+         out->colorspace == colorspace && !compression && !elide) {
+          DEBUG( "Writing decoded frames without conversion\n" );
+
+          out->passthrough = true;
+
+          out->iov = malloc( (num_rows + out->layout.num_planes) * sizeof(struct iovec) );
+          if (!out->iov) {
+               fprintf( stderr, "Failed to allocate I/O vectors!\n" );
+               return DFB_NOSYSTEMMEMORY;
+          }
+
+          return DFB_OK;
+     }
+
+     out->sws_ctx = sws_getContext( out->src_rect.w, out->src_rect.h, dec_ctx->pix_fmt,
+                                    out->dst_rect.w, out->dst_rect.h, out->pix_fmt, scaler, NULL, NULL, NULL );
+     if (!out->sws_ctx) {
+          fprintf( stderr, "Failed to create scaler!\n" );
+          return DFB_FAILURE;
+     }
+
+     /* Variants in another color space than the decoded one are converted to its coefficients. */
+     if (out->colorspace != colorspace) {
+          int *src_table, *dst_table;
+          int  src_range, dst_range;
+          int  brightness, contrast, saturation;
+
+          DEBUG( "Converting color space\n" );
+
+          sws_getColorspaceDetails( out->sws_ctx, &src_table, &src_range, &dst_table, &dst_range,
+                                    &brightness, &contrast, &saturation );
+
+          if (out->colorspace == DSCS_BT601_FULLRANGE)
+               dst_range = 1;
+
+          if (sws_setColorspaceDetails( out->sws_ctx, colorspace_coefficients( colorspace ), src_range,
+                                        colorspace_coefficients( out->colorspace ), dst_range,
+                                        brightness, contrast, saturation ) < 0) {
+               fprintf( stderr, "Unsupported color space conversion!\n" );
+               return DFB_UNSUPPORTED;
+          }
+     }
+
+     for (i = 0; i < RING_SIZE; i++) {
+          /* Page aligned for the writes, padding is written as cleared. */
+          if (posix_memalign( (void**) &out->buffers[i], sysconf( _SC_PAGESIZE ), out->layout.frame_size )) {
+               out->buffers[i] = NULL;
+               fprintf( stderr, "Failed to allocate frames!\n" );
+               return DFB_NOSYSTEMMEMORY;
+          }
+
+          memset( out->buffers[i], 0, out->layout.frame_size );
+
+          /* Borders around the scaled area are only cleared once. */
+          if (out->dst_rect.w != out->width || out->dst_rect.h != out->height) {
+               u8        *data[4];
+               int        linesize[4];
+               ptrdiff_t  pitch[4];
+               int        j;
+
+               frame_planes( &out->layout, out->buffers[i], data, linesize );
+
+               for (j = 0; j < 4; j++)
+                    pitch[j] = linesize[j];
+
+               av_image_fill_black( data, pitch, out->pix_fmt,
+                                    out->colorspace == DSCS_BT601_FULLRANGE ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG,
+                                    out->width, out->height );
+          }
+
+          ring_push( &out->free_buffers, out->buffers[i] );
+     }
+
+#ifdef HAVE_LIBURING
+     /* Frames of a fixed size are written at their offset, so that several ones can be in flight. */
+     if (!compression && fstat( out->fd, &st ) == 0 && S_ISREG( st.st_mode )) {
+          if (!out->positioned)
+               out->offset = lseek( out->fd, 0, SEEK_CUR );
+
+          if (out->offset >= 0 && io_uring_queue_init( RING_SIZE, &out->uring, 0 ) == 0) {
+               DEBUG( "Writing frames through io_uring\n" );
+
+               out->uring_ready = true;
+          }
+          else
+               DEBUG( "Failed to set up io_uring, writing frames synchronously\n" );
+     }
+#endif
+
+     return DFB_OK;
+}
+
+static bool output_start( Output *out )
+{
+     void *(*writer)( void* ) = out->passthrough ? passthrough_thread : write_thread;
+
+     if (!out->passthrough) {
+          if (pthread_create( &out->converter, NULL, convert_thread, out ))
+               return false;
+
+          out->converter_started = true;
+     }
+
+#ifdef HAVE_LIBURING
+     if (out->uring_ready)
+          writer = uring_write_thread;
+#endif
+
+     if (pthread_create( &out->writer, NULL, writer, out ))
+          return false;
+
+     out->writer_started = true;
+
+     return true;
+}
+
+static void output_join( Output *out )
+{
+     if (out->converter_started)
+          pthread_join( out->converter, NULL );
+
+     if (out->writer_started)
+          pthread_join( out->writer, NULL );
+
+     out->converter_started = false;
+     out->writer_started    = false;
+}
+
+static void output_deinit( Output *out )
+{
+     int i, j;
+
+#ifdef HAVE_LIBURING
+     /* Writes in flight have been reaped by the writer, unless waiting for them failed. Exiting the ring does not wait
+        for them, buffers still in a request are left allocated. */
+     if (out->uring_ready) {
+          io_uring_queue_exit( &out->uring );
+
+          for (i = 0; i < RING_SIZE; i++) {
+               for (j = 0; j < RING_SIZE; j++) {
+                    if (out->requests[j].buffer == out->buffers[i])
+                         out->buffers[i] = NULL;
+               }
+          }
+     }
+
+     out->uring_ready = false;
+#endif
+
+     for (i = 0; i < RING_SIZE; i++) {
+          if (out->buffers[i])
+               free( out->buffers[i] );
+     }
+
+     ring_deinit( &out->converted );
+     ring_deinit( &out->free_buffers );
+     ring_deinit( &out->decoded );
+
+     if (out->iov)
+          free( out->iov );
+
+     if (out->sws_ctx)
+          sws_freeContext( out->sws_ctx );
+}
+
+/*
+ * Passes a decoded frame 'count' times in a row to each output, up to the number of frames to output.
+ */
+static int pass_frame( Pipeline *pipeline, DecodedFrame *decoded, int64_t count, unsigned long *frames_decoded )
+{
+     int     i;
+     int64_t n;
+
+     if (nframes)
+          count = MIN( count, (int64_t) (nframes - *frames_decoded) );
+
+     if (count <= 0) {
+          av_frame_unref( decoded->frame );
+          ring_push( &pipeline->free_frames, decoded );
+          return nframes && *frames_decoded == nframes ? AVERROR_EOF : 0;
+     }
+
+     /* Frames beyond a segment would overwrite the next one. */
+     if (pipeline->max_frames && *frames_decoded + count > pipeline->max_frames) {
+          fprintf( stderr, "Frame timestamps don't match the frame rate, decode in one segment!\n" );
+          av_frame_unref( decoded->frame );
+          pipeline_abort( pipeline );
+          return AVERROR_EOF;
+     }
+
+     decoded->users = pipeline->num_outputs * count;
+
+     for (n = 0; n < count; n++) {
+          for (i = 0; i < pipeline->num_outputs; i++) {
+               if (!ring_push( &pipeline->outputs[i].decoded, decoded ))
+                    return AVERROR_EOF;
+          }
+
+          (*frames_decoded)++;
+     }
+
+     return *frames_decoded == nframes ? AVERROR_EOF : 0;
+}
+
+/*
+ * Frame rate conversion.
+ *
+ * Each output frame shows the last decoded frame at its time, so a decoded frame is held until the next one tells up
+ * to which output frame it is shown. Frames not shown at all are dropped before the conversion stages, or blended
+ * into the next one. As output frames are numbered from the start of the stream, segments decoded in parallel get
+ * the same frames as a single pass.
+ */
+
+/*
+ * Returns the output frame from which a decoded frame is shown, the first one at or after its timestamp, allowing
+ * for an eighth of a frame of jitter. Parallel segments also locate their frames in the output with it.
+ */
+static int64_t frame_slot( const AVStream *stream, int64_t pts )
+{
+     AVRational frame_time = { fps_den, fps_num };
+     int64_t    origin     = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+     int64_t    tolerance  = av_rescale_q( 1, frame_time, stream->time_base ) / 8;
+
+     return av_rescale_q_rnd( pts - origin - tolerance, stream->time_base, frame_time, AV_ROUND_UP );
+}
+
+/*
+ * Checks that all components of a pixel format are bytes, which can be averaged one by one.
+ */
+static bool blend_supported( enum AVPixelFormat pix_fmt )
+{
+     const AVPixFmtDescriptor *pix_desc = av_pix_fmt_desc_get( pix_fmt );
+     int                       i;
+
+     if (!pix_desc || (pix_desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL)))
+          return false;
+
+     for (i = 0; i < pix_desc->nb_components; i++) {
+          if (pix_desc->comp[i].depth != 8)
+               return false;
+     }
+
+     return true;
+}
+
+/*
+ * Averages a frame into another one, the frame having the weight of 'count' frames.
+ */
+static void blend_frames( AVFrame *dst, const AVFrame *src, int count )
+{
+     const AVPixFmtDescriptor *pix_desc = av_pix_fmt_desc_get( dst->format );
+     int                       i, x, y;
+     int                       bytes[4];
+     int                       rows[4] = { 0 };
+
+     av_image_fill_linesizes( bytes, dst->format, dst->width );
+
+     for (i = 0; i < pix_desc->nb_components; i++) {
+          const AVComponentDescriptor *comp   = &pix_desc->comp[i];
+          bool                         chroma = i == 1 || i == 2;
+
+          rows[comp->plane] = MAX( rows[comp->plane],
+                                   chroma ? AV_CEIL_RSHIFT( dst->height, pix_desc->log2_chroma_h ) : dst->height );
+     }
+
+     for (i = 0; i < 4; i++) {
+          for (y = 0; y < rows[i]; y++) {
+               const u8 *s = src->data[i] + y * src->linesize[i];
+               u8       *d = dst->data[i] + y * dst->linesize[i];
+
+               for (x = 0; x < bytes[i]; x++)
+                    d[x] = (s[x] * count + d[x] + (count + 1) / 2) / (count + 1);
+          }
+     }
+}
+
+/*
+ * Passes the held frame for the output frames up to 'until'.
+ */
+static int pass_held( Pipeline *pipeline, int64_t until, unsigned long *frames_decoded )
+{
+     DecodedFrame *held  = pipeline->held;
+     int64_t       count = MIN( until, pipeline->end_slot ) - pipeline->next_slot;
+
+     pipeline->held = NULL;
+
+     if (count > 0) {
+          pipeline->next_slot += count;
+          pipeline->repeated  += count - 1;
+     }
+     else
+          pipeline->dropped++;
+
+     return pass_frame( pipeline, held, count, frames_decoded );
+}
+
+static int convert_frame( Pipeline *pipeline, DecodedFrame *decoded, int64_t pts, unsigned long *frames_decoded )
+{
+     int     ret;
+     int64_t slot = pts != AV_NOPTS_VALUE ? frame_slot( pipeline->stream, pts ) : pipeline->next_slot + 1;
+
+     if (pipeline->held) {
+          if (pts != AV_NOPTS_VALUE && pipeline->held_pts != AV_NOPTS_VALUE)
+               pipeline->interval = pts - pipeline->held_pts;
+
+          if (pipeline->blend && slot <= pipeline->next_slot && av_frame_make_writable( decoded->frame ) >= 0) {
+               blend_frames( decoded->frame, pipeline->held->frame, ++pipeline->blended );
+
+               av_frame_unref( pipeline->held->frame );
+               ring_push( &pipeline->free_frames, pipeline->held );
+
+               pipeline->held = NULL;
+               pipeline->dropped++;
+          }
+          else {
+               pipeline->blended = 0;
+
+               ret = pass_held( pipeline, slot, frames_decoded );
+               if (ret < 0) {
+                    av_frame_unref( decoded->frame );
+                    ring_push( &pipeline->free_frames, decoded );
+                    return ret;
+               }
+          }
+     }
+
+     pipeline->held     = decoded;
+     pipeline->held_pts = pts;
+
+     return 0;
+}
+
+/*
+ * Passes all frames available from the decoder to each output.
+ */
+static int receive_frames( AVCodecContext *dec_ctx, Pipeline *pipeline, unsigned long *frames_decoded )
+{
+     int     ret;
+     int64_t pts;
+
+     while (true) {
+          DecodedFrame *decoded = ring_pop( &pipeline->free_frames );
+
+          if (!decoded)
+               return AVERROR_EOF;
+
+          ret = avcodec_receive_frame( dec_ctx, decoded->frame );
+          if (ret < 0) {
+               ring_push( &pipeline->free_frames, decoded );
+               return ret;
+          }
+
+          /* Frames decoded from the keyframe preceding the start position, or beyond the duration. */
+          pts = decoded->frame->best_effort_timestamp;
+          if (pts != AV_NOPTS_VALUE) {
+               if (pts < pipeline->start_pts) {
+                    av_frame_unref( decoded->frame );
+                    ring_push( &pipeline->free_frames, decoded );
+                    pipeline->skipped++;
+                    continue;
+               }
+
+               if (pipeline->end_pts != AV_NOPTS_VALUE && pts >= pipeline->end_pts) {
+                    av_frame_unref( decoded->frame );
+                    ring_push( &pipeline->free_frames, decoded );
+
+                    if (pipeline->held)
+                         pass_held( pipeline, pipeline->end_slot, frames_decoded );
+
+                    return AVERROR_EOF;
+               }
+          }
+
+          ret = pipeline->convert_rate ? convert_frame( pipeline, decoded, pts, frames_decoded ) :
+                                         pass_frame( pipeline, decoded, 1, frames_decoded );
+          if (ret < 0)
+               return ret;
+     }
+}
+
+/*
+ * Converts the start position and the duration to timestamps of the video stream, AV_NOPTS_VALUE if not limited.
+ */
+static void decode_range( const VideoInput *input, int64_t *ret_start, int64_t *ret_end )
+{
+     AVStream *stream = input->fmt_ctx->streams[input->stream_index];
+     int64_t   offset = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+     int64_t   start  = offset + av_rescale_q( start_time, AV_TIME_BASE_Q, stream->time_base );
+
+     *ret_start = start_time ? start : AV_NOPTS_VALUE;
+     *ret_end   = duration   ? start + av_rescale_q( duration, AV_TIME_BASE_Q, stream->time_base ) : AV_NOPTS_VALUE;
+
+     /* Starting half a frame before the first output frame at or after the start, frames are numbered the same way in
+        parallel segments as in a single pass. */
+     if (start_time && fps_num) {
+          AVRational frame_time = { fps_den, fps_num };
+
+          *ret_start = offset + av_rescale_q( frame_slot( stream, start ), frame_time, stream->time_base ) -
+                       av_rescale_q( 1, frame_time, stream->time_base ) / 2;
+     }
+}
+
+/*
+ * Decodes the frames from 'start_pts' (seeking to the preceding keyframe) up to 'end_pts' and passes them to the
+ * outputs, failing beyond 'max_frames' if not 0.
+ */
+static DFBResult decode_frames( VideoInput *input, Output *outputs, int num_outputs, int64_t start_pts,
+                                int64_t end_pts, unsigned long max_frames, unsigned long *ret_frames )
+{
+     int            i;
+     int            ret;
+     int            num_init       = 0;
+     Pipeline       pipeline;
+     AVPacket      *pkt            = NULL;
+     unsigned long  frames_decoded = 0;
+     DFBResult      result         = DFB_FAILURE;
+
+     memset( &pipeline, 0, sizeof(pipeline) );
+
+     pthread_mutex_init( &pipeline.lock, NULL );
+
+     ring_init( &pipeline.free_frames );
+
+     pipeline.outputs     = outputs;
+     pipeline.num_outputs = num_outputs;
+     pipeline.start_pts   = start_pts;
+     pipeline.end_pts     = end_pts;
+     pipeline.max_frames  = max_frames;
+
+     if (convert_rate) {
+          pipeline.convert_rate = true;
+          pipeline.stream       = input->fmt_ctx->streams[input->stream_index];
+          pipeline.next_slot    = start_pts != AV_NOPTS_VALUE ? frame_slot( pipeline.stream, start_pts ) : 0;
+          pipeline.end_slot     = end_pts   != AV_NOPTS_VALUE ? frame_slot( pipeline.stream, end_pts )   : INT64_MAX;
+
+          if (blend) {
+               pipeline.blend = blend_supported( input->dec_ctx->pix_fmt );
+               if (!pipeline.blend)
+                    DEBUG( "Frames of %s can't be blended, dropping them instead\n",
+                           av_get_pix_fmt_name( input->dec_ctx->pix_fmt ) );
+          }
+     }
+
+     /* Seek to the preceding keyframe, the decoder has to start from there. */
+     if (start_pts != AV_NOPTS_VALUE) {
+          if (av_seek_frame( input->fmt_ctx, input->stream_index, start_pts, AVSEEK_FLAG_BACKWARD ) < 0)
+               DEBUG( "Failed to seek, decoding from the beginning\n" );
+          else
+               avcodec_flush_buffers( input->dec_ctx );
+     }
+
+     for (num_init = 0; num_init < num_outputs; num_init++) {
+          if (output_init( &outputs[num_init], &pipeline, input->dec_ctx )) {
+               num_init++;
+               goto out;
+          }
+     }
+
+     pkt = av_packet_alloc();
+     if (!pkt)
+          goto out;
+
+     for (i = 0; i < RING_SIZE; i++) {
+          pipeline.frames[i].frame = av_frame_alloc();
+          if (!pipeline.frames[i].frame) {
+               fprintf( stderr, "Failed to allocate frames!\n" );
+               goto out;
+          }
+
+          ring_push( &pipeline.free_frames, &pipeline.frames[i] );
+     }
+
+     for (i = 0; i < num_outputs; i++) {
+          if (!output_start( &outputs[i] )) {
+               fprintf( stderr, "Failed to create output threads!\n" );
+               pipeline_abort( &pipeline );
+               goto join;
+          }
+     }
+
+     ret = 0;
+
+     while (ret != AVERROR_EOF && av_read_frame( input->fmt_ctx, pkt ) >= 0) {
+          if (pkt->stream_index == input->stream_index) {
+               /* Corrupted packets are skipped. */
+               if (avcodec_send_packet( input->dec_ctx, pkt ) < 0)
+                    DEBUG( "Failed to decode packet!\n" );
+
+               ret = receive_frames( input->dec_ctx, &pipeline, &frames_decoded );
+               if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                    fprintf( stderr, "Failed to decode frame!\n" );
+                    av_packet_unref( pkt );
+                    pipeline_abort( &pipeline );
+                    break;
+               }
+          }
+
+          av_packet_unref( pkt );
+     }
+
+     /* Drain the frames delayed by the decoder. */
+     if (ret != AVERROR_EOF && !pipeline.failed) {
+          avcodec_send_packet( input->dec_ctx, NULL );
+
+          receive_frames( input->dec_ctx, &pipeline, &frames_decoded );
+     }
+
+     /* The last frame is shown as long as the one before. */
+     if (pipeline.held && !pipeline.failed) {
+          int64_t until = pipeline.next_slot + 1;
+
+          if (pipeline.interval)
+               until = frame_slot( pipeline.stream, pipeline.held_pts + pipeline.interval );
+
+          pass_held( &pipeline, until, &frames_decoded );
+     }
+
+     for (i = 0; i < num_outputs; i++)
+          ring_close( &outputs[i].decoded );
+
+     DEBUG( "Decoded %lu frames (%lu skipped)\n", frames_decoded, pipeline.skipped );
+
+     if (pipeline.convert_rate)
+          DEBUG( "Frame rate conversion: %lu frames %s, %lu repeated\n",
+                 pipeline.dropped, pipeline.blend ? "blended" : "dropped", pipeline.repeated );
+
+     if (ret_frames)
+          *ret_frames = frames_decoded;
+
+join:
+     for (i = 0; i < num_outputs; i++)
+          output_join( &outputs[i] );
+
+     if (!pipeline.failed)
+          result = DFB_OK;
+
+out:
+     for (i = 0; i < RING_SIZE; i++) {
+          if (pipeline.frames[i].frame)
+               av_frame_free( &pipeline.frames[i].frame );
+     }
+
+     if (pkt)
+          av_packet_free( &pkt );
+
+     for (i = 0; i < num_init; i++)
+          output_deinit( &outputs[i] );
+
+     ring_deinit( &pipeline.free_frames );
+
+     pthread_mutex_destroy( &pipeline.lock );
+
+     return result;
+}
+
+/*
+ * Parallel decoding.
+ *
+ * The video is split into segments starting at keyframes, each one decoded by its own demuxer and decoder into its
+ * own pipeline. As DFVFF frames have a fixed size, the frames of each segment are written at their final offset in
+ * the output files, computed from the timestamp of the first frame at a constant frame rate. A segment decoding more
+ * frames than it has room for fails before writing them, fewer frames fail once all segments are decoded.
+ */
+
+typedef struct {
+     VideoInput         *input;
+     VideoInput          own_input;     /* all segments but the first one */
+
+     Output              outputs[MAX_VARIANTS+1];
+     int                 num_outputs;
+
+     int64_t             start_pts;
+     int64_t             end_pts;
+     unsigned long       first_frame;   /* index of the first frame of the segment in the output */
+     unsigned long       max_frames;    /* up to the next segment or to the end, 0 if unlimited */
+     unsigned long       frames;        /* frames decoded */
+
+     pthread_t           thread;
+     bool                started;
+     DFBResult           result;
+} Segment;
+
+static void *segment_thread( void *arg )
+{
+     Segment *segment = arg;
+
+     segment->result = decode_frames( segment->input, segment->outputs, segment->num_outputs,
+                                      segment->start_pts, segment->end_pts, segment->max_frames, &segment->frames );
+
+     return NULL;
+}
+
+/*
+ * Returns the timestamp of the keyframe at or preceding a timestamp, AV_NOPTS_VALUE if not found.
+ */
+static int64_t find_keyframe( VideoInput *input, AVPacket *pkt, int64_t ts )
+{
+     int64_t key = AV_NOPTS_VALUE;
+
+     if (av_seek_frame( input->fmt_ctx, input->stream_index, ts, AVSEEK_FLAG_BACKWARD ) < 0)
+          return AV_NOPTS_VALUE;
+
+     while (key == AV_NOPTS_VALUE && av_read_frame( input->fmt_ctx, pkt ) >= 0) {
+          if (pkt->stream_index == input->stream_index && (pkt->flags & AV_PKT_FLAG_KEY))
+               key = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+
+          av_packet_unref( pkt );
+     }
+
+     return key;
+}
+
+static DFBResult decode_segments( VideoInput *input, Output *outputs, int num_outputs, int64_t start_pts,
+                                  int64_t end_pts )
+{
+     int            i, j;
+     int            num_segments = 1;
+     AVStream      *stream       = input->fmt_ctx->streams[input->stream_index];
+     AVRational     frame_time   = { fps_den, fps_num };
+     int64_t        offset       = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+     int64_t        first        = start_pts != AV_NOPTS_VALUE ? start_pts : offset;
+     int64_t        last         = end_pts;
+     unsigned long  first_frame;
+     off_t          base[MAX_VARIANTS+1];
+     Segment       *segments     = NULL;
+     AVPacket      *pkt          = NULL;
+     DFBResult      result       = DFB_FAILURE;
+
+     /* Frames are written at their offset. */
+     for (i = 0; i < num_outputs; i++) {
+          base[i] = lseek( outputs[i].fd, 0, SEEK_CUR );
+          if (base[i] < 0) {
+               fprintf( stderr, "Parallel decoding is only supported for output files!\n" );
+               return DFB_UNSUPPORTED;
+          }
+     }
+
+     if (nframes && fps_num) {
+          int64_t limit = first + av_rescale_q( nframes, frame_time, stream->time_base );
+
+          if (end_pts == AV_NOPTS_VALUE || limit < end_pts)
+               end_pts = last = limit;
+     }
+
+     if (last == AV_NOPTS_VALUE) {
+          if (stream->duration != AV_NOPTS_VALUE)
+               last = offset + stream->duration;
+          else if (input->fmt_ctx->duration != AV_NOPTS_VALUE)
+               last = offset + av_rescale_q( input->fmt_ctx->duration, AV_TIME_BASE_Q, stream->time_base );
+     }
+
+     if (!fps_num || last == AV_NOPTS_VALUE) {
+          DEBUG( "Unknown frame rate or duration, decoding in one segment\n" );
+          return decode_frames( input, outputs, num_outputs, start_pts, end_pts, 0, NULL );
+     }
+
+     segments = calloc( jobs, sizeof(Segment) );
+     pkt      = av_packet_alloc();
+     if (!segments || !pkt) {
+          fprintf( stderr, "Failed to allocate segments!\n" );
+          goto out;
+     }
+
+     /* Split the video at the keyframes preceding evenly spaced positions. */
+     segments[0].start_pts = first;
+
+     for (i = 1; i < jobs; i++) {
+          int64_t key = find_keyframe( input, pkt, first + (last - first) * i / jobs );
+
+          if (key != AV_NOPTS_VALUE && key > segments[num_segments-1].start_pts && key < last) {
+               segments[num_segments-1].end_pts = key;
+               segments[num_segments++].start_pts = key;
+          }
+     }
+
+     segments[num_segments-1].end_pts = end_pts;
+
+     first_frame = frame_slot( stream, first );
+
+     for (i = 0; i < num_segments; i++) {
+          Segment *segment = &segments[i];
+
+          if (i) {
+               segment->first_frame = frame_slot( stream, segment->start_pts ) - first_frame;
+
+               if (segment->first_frame <= segments[i-1].first_frame) {
+                    fprintf( stderr, "Frame timestamps don't match the frame rate, decode in one segment!\n" );
+                    goto out;
+               }
+
+               segments[i-1].max_frames = segment->first_frame - segments[i-1].first_frame;
+
+               if (open_decoder( &segment->own_input ))
+                    goto out;
+
+               segment->input = &segment->own_input;
+          }
+          else
+               segment->input = input;
+
+          segment->num_outputs = num_outputs;
+
+          for (j = 0; j < num_outputs; j++) {
+               Output *out = &segment->outputs[j];
+
+               *out = outputs[j];
+
+               out->positioned = true;
+               out->offset     = base[j] + (off_t) segment->first_frame * out->layout.frame_size;
+          }
+     }
+
+     /* The last segment ends at the end position, if limited. */
+     if (end_pts != AV_NOPTS_VALUE)
+          segments[num_segments-1].max_frames = frame_slot( stream, end_pts ) - first_frame -
+                                                segments[num_segments-1].first_frame;
+
+     DEBUG( "Decoding %d segment(s) in parallel\n", num_segments );
+
+     for (i = 0; i < num_segments; i++) {
+          if (pthread_create( &segments[i].thread, NULL, segment_thread, &segments[i] )) {
+               fprintf( stderr, "Failed to create segment threads!\n" );
+               break;
+          }
+
+          segments[i].started = true;
+     }
+
+     result = DFB_OK;
+
+     for (i = 0; i < num_segments; i++) {
+          if (!segments[i].started) {
+               result = DFB_FAILURE;
+               continue;
+          }
+
+          pthread_join( segments[i].thread, NULL );
+
+          DEBUG( "Segment %d: %lu frames from frame %lu\n", i, segments[i].frames, segments[i].first_frame );
+
+          if (segments[i].result)
+               result = segments[i].result;
+     }
+
+     /* The frame count of each segment is only known in advance at a constant frame rate. */
+     for (i = 0; i < num_segments - 1 && !result; i++) {
+          if (segments[i].first_frame + segments[i].frames != segments[i+1].first_frame) {
+               fprintf( stderr, "Frame timestamps don't match the frame rate, decode in one segment!\n" );
+               result = DFB_FAILURE;
+          }
+     }
+
+out:
+     if (segments) {
+          for (i = 1; i < num_segments; i++)
+               close_video( &segments[i].own_input );
+
+          free( segments );
+     }
+
+     if (pkt)
+          av_packet_free( &pkt );
+
+     return result;
+}
+
+typedef enum {
+     COPY_FILE_RANGE,
+     COPY_SPLICE,
+     COPY_SENDFILE,
+     COPY_READ_WRITE
+} CopyMethod;
+
+/*
+ * Copies raw frames to the output within the kernel if possible: copy_file_range() between files (sharing extents on
+ * file systems supporting it), splice() to a pipe, sendfile() otherwise. Each method falls back to the next one if
+ * unsupported for the input and output, down to read() and write() through the frame buffer.
+ */
+static DFBResult copy_frames( int fd, int out_fd, u64 length, u8 *buffer, int buffer_size )
+{
+     CopyMethod  method = COPY_FILE_RANGE;
+     struct stat st;
+
+     if (fstat( out_fd, &st ) == 0 && S_ISFIFO( st.st_mode ))
+          method = COPY_SPLICE;
+
+     while (length) {
+          size_t  chunk = MIN( length, COPY_CHUNK );
+          ssize_t ret   = -1;
 
-          switch (desc->pixelformat) {
-               case DSPF_I420:
-                    pix_fmt = AV_PIX_FMT_YUV420P;
+          errno = ENOSYS;
+
+          switch (method) {
+#ifdef HAVE_COPY_FILE_RANGE
+               case COPY_FILE_RANGE:
+                    ret = copy_file_range( fd, NULL, out_fd, NULL, chunk, 0 );
+                    break;
+#endif
+#ifdef HAVE_SPLICE
+               case COPY_SPLICE:
+                    ret = splice( fd, NULL, out_fd, NULL, chunk, SPLICE_F_MORE );
                     break;
-               case DSPF_Y42B:
-                    pix_fmt = AV_PIX_FMT_YUV422P;
+#endif
+#ifdef HAVE_SENDFILE
+               case COPY_SENDFILE:
+                    ret = sendfile( out_fd, fd, NULL, chunk );
                     break;
-               case DSPF_Y444:
-                    pix_fmt = AV_PIX_FMT_YUV444P;
+#endif
+               case COPY_READ_WRITE:
+                    ret = read( fd, buffer, MIN( chunk, buffer_size ) );
+                    if (ret > 0) {
+                         struct iovec iov = { buffer, ret };
+
+                         if (!write_iov( out_fd, NULL, &iov, 1 )) {
+                              fprintf( stderr, "Failed to write frame!\n" );
+                              return DFB_IO;
+                         }
+                    }
                     break;
+
                default:
-                    fprintf( stderr, "Unsupported format conversion!\n" );
-                    return;
+                    break;
           }
 
-          sws_ctx = sws_getContext( width, height, fmt_ctx->streams[0]->codec->pix_fmt, width, height, pix_fmt,
-                                    SWS_FAST_BILINEAR, NULL, NULL, NULL );
+          if (ret < 0) {
+               if (errno == EINTR)
+                    continue;
 
-          avpicture_fill( &picture, desc->preallocated[0].data, pix_fmt, width, height );
+               /* Nothing has been copied, try the next method. */
+               if (method != COPY_READ_WRITE && (errno == ENOSYS || errno == EINVAL || errno == EXDEV ||
+                                                 errno == EOPNOTSUPP || errno == EBADF || errno == ESPIPE)) {
+                    method = method == COPY_FILE_RANGE ? COPY_SENDFILE : method + 1;
+                    continue;
+               }
 
-          frame = av_frame_alloc();
-          if (!frame)
-               goto out;
-          else
-               frames_decoded = 0;
+               fprintf( stderr, "Failed to copy raw frames (%s)!\n", strerror( errno ) );
+               return DFB_IO;
+          }
+
+          if (!ret) {
+               fprintf( stderr, "Failed to read raw file!\n" );
+               return DFB_IO;
+          }
+
+          length -= ret;
+     }
+
+     DEBUG( "Copied raw frames using %s\n", method == COPY_FILE_RANGE ? "copy_file_range()" :
+                                            method == COPY_SPLICE     ? "splice()"          :
+                                            method == COPY_SENDFILE   ? "sendfile()"        : "read() and write()" );
+
+     return DFB_OK;
+}
 
-          while (av_read_frame( fmt_ctx, &pkt ) >= 0) {
-               avcodec_decode_video2( fmt_ctx->streams[0]->codec, frame, &got_frame, &pkt );
+/*
+ * Reads a raw frame, returning its length which is less than the frame size at the end of the input.
+ */
+static int read_frame( int fd, u8 *buffer, int frame_size )
+{
+     int length = 0;
 
-               av_free_packet( &pkt );
+     while (length < frame_size) {
+          ssize_t ret = read( fd, buffer + length, frame_size - length );
 
-               if (got_frame) {
-                    sws_scale( sws_ctx, (void*) frame->data, frame->linesize, 0, height, picture.data, picture.linesize );
+          if (ret < 0 && errno == EINTR)
+               continue;
 
-                    fwrite( desc->preallocated[0].data, 1, frame_size, stdout );
+          if (ret < 0)
+               return -1;
 
-                    frames_decoded++;
-                    if (frames_decoded == nframes)
-                         break;
+          if (!ret)
+               break;
+
+          length += ret;
+     }
+
+     return length;
+}
+
+/*
+ * Copies raw frames one by one, with the padding of the frame layout, compressed, or elided if repeated, up to the
+ * end of the input for an unknown count.
+ */
+static DFBResult copy_single_frames( int fd, Output *out, u8 *buffer, int frame_size, unsigned long limit )
+{
+     const FrameLayout *layout = &out->layout;
+     unsigned long      n;
+     int                i;
+
+     for (n = 0; n < limit; n++) {
+          struct iovec  iov[8];
+          u8           *src;
+          int           count  = 0;
+          int           length = read_frame( fd, buffer, frame_size );
+
+          if (length < 0) {
+               fprintf( stderr, "Failed to read frame!\n" );
+               return DFB_IO;
+          }
+
+          /* Incomplete frames at the end are dropped. */
+          if (length < frame_size)
+               break;
+
+          if (elide) {
+               u64  hash = threshold ? 0 : hash_bytes( HASH_SEED, buffer, frame_size );
+               bool repeat;
+
+               if (!elide_frame( out, buffer, frame_size, hash, &repeat )) {
+                    fprintf( stderr, "Failed to write frame!\n" );
+                    return DFB_IO;
+               }
+
+               if (repeat)
+                    continue;
+          }
+
+          if (compression) {
+               if (!write_compressed( out, buffer )) {
+                    fprintf( stderr, "Failed to write frame!\n" );
+                    return DFB_IO;
+               }
+
+               continue;
+          }
+
+          for (i = 0, src = buffer; i < layout->num_planes; i++) {
+               int padding = plane_padding( layout, i );
+
+               iov[count].iov_base = src;
+               iov[count].iov_len  = layout->plane_bytes[i] * layout->plane_rows[i];
+
+               src += iov[count++].iov_len;
+
+               if (padding) {
+                    iov[count].iov_base = out->padding;
+                    iov[count].iov_len  = padding;
+                    count++;
                }
           }
+
+          if (!write_iov( out->fd, NULL, iov, count )) {
+               fprintf( stderr, "Failed to write frame!\n" );
+               return DFB_IO;
+          }
      }
 
-out:
-     if (fp)
-          fclose( fp );
+     DEBUG( "Copied %lu raw frames\n", n );
+
+     return DFB_OK;
+}
+
+static DFBResult write_frames( VideoInput *input, DFBSurfaceDescription *desc, Output *outputs, int num_outputs )
+{
+     int           frame_size;
+     unsigned long n;
+     u8           *buffer = desc->preallocated[0].data;
+
+     if (input->fmt_ctx) {
+          int64_t start_pts, end_pts;
+
+          decode_range( input, &start_pts, &end_pts );
 
-     if (frame)
-          av_free( frame );
+          if (jobs > 1)
+               return decode_segments( input, outputs, num_outputs, start_pts, end_pts );
 
-     if (sws_ctx)
-          sws_freeContext( sws_ctx );
+          return decode_frames( input, outputs, num_outputs, start_pts, end_pts, 0, NULL );
+     }
+
+     frame_size = DFB_BYTES_PER_LINE( desc->pixelformat, width ) * DFB_PLANE_MULTIPLY( desc->pixelformat, height );
+
+     /* Raw frames are located by their offset, no need to read the preceding ones, unless streamed. */
+     if (input->streaming) {
+          for (n = 0; n < raw_frames( start_time ); n++) {
+               int length = read_frame( fileno( input->fp ), buffer, frame_size );
 
-     if (fmt_ctx) {
-          avcodec_close( fmt_ctx->streams[0]->codec );
-          avformat_close_input( &fmt_ctx );
+               if (length < 0) {
+                    fprintf( stderr, "Failed to read frame!\n" );
+                    return DFB_IO;
+               }
+
+               if (length < frame_size)
+                    break;
+          }
      }
+     else if (start_time && lseek( fileno( input->fp ), (off_t) raw_frames( start_time ) * frame_size, SEEK_SET ) < 0) {
+          fprintf( stderr, "Failed to seek to the start position!\n" );
+          return DFB_FAILURE;
+     }
+
+     /* Streamed frames are read up to the end, which may come before the number of frames requested. */
+     if (input->streaming)
+          return copy_single_frames( fileno( input->fp ), &outputs[0], buffer, frame_size, nframes ?: ULONG_MAX );
+
+     if (outputs[0].layout.frame_size != frame_size || align_planes || compression || elide)
+          return copy_single_frames( fileno( input->fp ), &outputs[0], buffer, frame_size, nframes );
+
+     return copy_frames( fileno( input->fp ), outputs[0].fd, (u64) nframes * frame_size, buffer, frame_size );
 }
 
 /**********************************************************************************************************************/
@@ -485,46 +3079,434 @@ static DFVFFHeader header = {
      flags: 0x01
 };
 
+static DFBResult open_output( Output *out, const OutputSpec *spec )
+{
+     int              i, j;
+     int              count       = 1;
+     DFVFFHeader      file_header = header;
+     DFVFFLayout      layout;
+     DFVFFCompression compressed;
+     DFVFFRepeats     repeats;
+     size_t           extensions  = sizeof(file_header);
+     struct iovec     iov[5]      = { { &file_header, sizeof(file_header) } };
+
+     memset( out, 0, sizeof(Output) );
+
+     out->fd         = -1;
+     out->filename   = spec->filename;
+     out->format     = spec->format;
+     out->width      = spec->width;
+     out->height     = spec->height;
+     out->colorspace = spec->colorspace;
+
+     /* Compressed frames have their repeats in the frame index. */
+     out->repeat_table = elide && !compression;
+
+     if (!check_frame_size( spec->format, spec->width, spec->height )) {
+          fprintf( stderr, "Frame size %dx%d is not a multiple of the chroma subsampling of the format!\n",
+                   spec->width, spec->height );
+          return DFB_INVARG;
+     }
+
+     frame_layout( &out->layout, spec->format, spec->width, spec->height );
+
+     if (alignment) {
+          out->padding = calloc( 1, alignment );
+          if (!out->padding) {
+               fprintf( stderr, "Failed to allocate padding!\n" );
+               return DFB_NOSYSTEMMEMORY;
+          }
+     }
+
+     if (compression || elide) {
+          out->previous = malloc( out->layout.frame_size );
+          if (!out->previous) {
+               fprintf( stderr, "Failed to allocate previous frame!\n" );
+               return DFB_NOSYSTEMMEMORY;
+          }
+     }
+
+     if (compression) {
+          out->difference = malloc( out->layout.frame_size );
+          out->packed     = malloc( RLE_BOUND( out->layout.frame_size ) );
+          if (!out->difference || !out->packed) {
+               fprintf( stderr, "Failed to allocate compression buffers!\n" );
+               return DFB_NOSYSTEMMEMORY;
+          }
+     }
+
+     if (spec->filename) {
+          /* Compressed frames are read back for the benchmark. */
+          out->fd = open( spec->filename, (benchmark ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0644 );
+          if (out->fd < 0) {
+               fprintf( stderr, "Failed to open '%s'!\n", spec->filename );
+               return DFB_IO;
+          }
+     }
+     else
+          out->fd = STDOUT_FILENO;
+
+     /* The frame index or repeat table is written at the end, its offset in the header if possible. */
+     out->seekable = lseek( out->fd, 0, SEEK_CUR ) >= 0;
+
+     /* Frames are read back from the output file, the standard output is usually not opened for reading. */
+     if (benchmark && (!out->seekable || (fcntl( out->fd, F_GETFL ) & O_ACCMODE) != O_RDWR)) {
+          fprintf( stderr, "The benchmark is only supported for output files!\n" );
+          return DFB_UNSUPPORTED;
+     }
+
+     for (i = 0; i < D_ARRAY_SIZE(format_names); i++) {
+          if (format_names[i].format == spec->format) {
+               for (j = 0; j < D_ARRAY_SIZE(colorspace_names); j++) {
+                    if (colorspace_names[j].colorspace == spec->colorspace) {
+                         DEBUG( "Writing video (%lu frames) to %s: %dx%d, %s (%s), %u/%u fps\n", nframes,
+                                spec->filename ?: "standard output", spec->width, spec->height,
+                                format_names[i].name, colorspace_names[j].name, fps_num, fps_den );
+                         break;
+                    }
+               }
+          }
+     }
+
+     file_header.width      = spec->width;
+     file_header.height     = spec->height;
+     file_header.format     = spec->format;
+     file_header.colorspace = spec->colorspace;
+
+     file_header.framerate_num = fps_num;
+     file_header.framerate_den = fps_den;
+
+     if (alignment)
+          extensions += sizeof(layout);
+
+     if (out->repeat_table)
+          extensions += sizeof(repeats);
+
+     /* The layout follows the header, padded up to the first frame. */
+     if (alignment) {
+          memset( &layout, 0, sizeof(layout) );
+
+          layout.alignment    = alignment;
+          layout.frame_offset = ALIGN_UP( extensions, alignment );
+          layout.frame_size   = out->layout.frame_size;
+          layout.num_planes   = out->layout.num_planes;
+
+          for (i = 0; i < out->layout.num_planes; i++)
+               layout.plane_offset[i] = out->layout.plane_offset[i];
+
+          file_header.minor  = MAX( file_header.minor, 1 );
+          file_header.flags |= DFVFF_FLAG_ALIGNED;
+
+          iov[count].iov_base = &layout;
+          iov[count].iov_len  = sizeof(layout);
+          count++;
+
+          DEBUG( "Aligning frames to %u bytes%s, %d bytes per frame\n", alignment,
+                 align_planes ? " (and planes)" : "", out->layout.frame_size );
+     }
+
+     /* Completed once all frames are written. */
+     if (out->repeat_table) {
+          memset( &repeats, 0, sizeof(repeats) );
+
+          repeats.threshold = threshold;
+
+          file_header.minor  = MAX( file_header.minor, 1 );
+          file_header.flags |= DFVFF_FLAG_REPEATS;
+
+          iov[count].iov_base = &repeats;
+          iov[count].iov_len  = sizeof(repeats);
+          count++;
+
+          out->position = alignment ? layout.frame_offset : extensions;
+     }
+
+     if (alignment) {
+          iov[count].iov_base = out->padding;
+          iov[count].iov_len  = layout.frame_offset - extensions;
+          count++;
+     }
+
+     /* Completed once all frames are written. */
+     if (compression) {
+          memset( &compressed, 0, sizeof(compressed) );
+
+          compressed.codec             = DFVFF_CODEC_RLE;
+          compressed.keyframe_interval = keyframe_interval;
+
+          file_header.minor  = MAX( file_header.minor, 1 );
+          file_header.flags |= DFVFF_FLAG_COMPRESSED;
+
+          iov[count].iov_base = &compressed;
+          iov[count].iov_len  = sizeof(compressed);
+          count++;
+
+          out->position = sizeof(file_header) + sizeof(compressed);
+     }
+
+     if (!write_iov( out->fd, NULL, iov, count )) {
+          fprintf( stderr, "Failed to write header!\n" );
+          return DFB_IO;
+     }
+
+     return DFB_OK;
+}
+
+/*
+ * Writes the repeat table of elided frames and completes its header.
+ */
+static DFBResult write_repeats( Output *out )
+{
+     static u8    zeros[8];
+     DFVFFRepeats repeats;
+     u64          end     = out->position + (u64) out->num_stored * out->layout.frame_size;
+     struct iovec iov[3]  = { { zeros,        ALIGN_UP( end, 8 ) - end },
+                              { out->repeats, out->num_repeats * sizeof(DFVFFRepeatEntry) },
+                              { &repeats,     sizeof(repeats) } };
+
+     memset( &repeats, 0, sizeof(repeats) );
+
+     repeats.num_frames   = out->num_stored + out->num_repeated;
+     repeats.num_repeats  = out->num_repeats;
+     repeats.threshold    = threshold;
+     repeats.table_offset = ALIGN_UP( end, 8 );
+
+     /* Appended as a trailer if the header can not be completed, the table is aligned as the frame index. */
+     if (!write_iov( out->fd, NULL, iov, out->seekable ? 2 : 3 ) ||
+         (out->seekable &&
+          pwrite( out->fd, &repeats, sizeof(repeats),
+                  sizeof(DFVFFHeader) + (alignment ? sizeof(DFVFFLayout) : 0) ) != sizeof(repeats))) {
+          fprintf( stderr, "Failed to write repeat table!\n" );
+          return DFB_IO;
+     }
+
+     return DFB_OK;
+}
+
+/*
+ * Writes the frame index of compressed frames or the repeat table of elided frames, and completes the header.
+ */
+static DFBResult finish_output( Output *out )
+{
+     static u8        zeros[8];
+     DFVFFCompression compressed;
+     u64              length;
+     unsigned long    stored;
+     struct iovec     iov[3] = { { zeros,       ALIGN_UP( out->position, 8 ) - out->position },
+                                 { out->index,  out->num_frames * sizeof(DFVFFFrameEntry) },
+                                 { &compressed, sizeof(compressed) } };
+
+     if (elide)
+          DEBUG( "Elided %lu of %lu frames\n", out->num_repeated, out->num_stored + out->num_repeated );
+
+     if (out->repeat_table)
+          return write_repeats( out );
+
+     if (!compression)
+          return DFB_OK;
+
+     memset( &compressed, 0, sizeof(compressed) );
+
+     compressed.codec             = DFVFF_CODEC_RLE;
+     compressed.keyframe_interval = keyframe_interval;
+     compressed.num_frames        = out->num_frames;
+     compressed.index_offset      = ALIGN_UP( out->position, 8 );
+
+     /* Appended as a trailer if the header can not be completed, the index is aligned for its 64 bit offsets. */
+     if (!write_iov( out->fd, NULL, iov, out->seekable ? 2 : 3 ) ||
+         (out->seekable &&
+          pwrite( out->fd, &compressed, sizeof(compressed), sizeof(DFVFFHeader) ) != sizeof(compressed))) {
+          fprintf( stderr, "Failed to write frame index!\n" );
+          return DFB_IO;
+     }
+
+     length = out->position - sizeof(DFVFFHeader) - sizeof(compressed);
+
+     stored = out->num_frames - out->num_repeated;
+
+     DEBUG( "Compressed %lu frames to %llu bytes (%.1f%%)\n", stored, (unsigned long long) length,
+            stored ? 100.0 * length / ((double) stored * out->layout.frame_size) : 0.0 );
+
+     return DFB_OK;
+}
+
+/*
+ * Decodes all compressed frames of an output file, as a player would do, reading one keyframe group at a time.
+ */
+static DFBResult run_benchmark( Output *out )
+{
+     DFBResult      ret         = DFB_OK;
+     unsigned long  i, j, k;
+     long long      start;
+     long long      decode_time = 0;
+     u64            first       = out->num_frames ? out->index[0].offset : 0;
+     u64            length      = out->position - first;
+     u8            *data        = NULL;
+     size_t         max_size    = 0;
+     u8            *frame       = malloc( out->layout.frame_size );
+     double         rate        = fps_den ? (double) fps_num / fps_den : 0.0;
+
+     if (!frame) {
+          fprintf( stderr, "Failed to allocate frame!\n" );
+          return DFB_NOSYSTEMMEMORY;
+     }
+
+     for (i = 0; i < out->num_frames; i = j) {
+          u64    offset = out->index[i].offset;
+          size_t size;
+
+          /* A group runs up to the next keyframe, its frames following each other in the file. */
+          for (j = i + 1; j < out->num_frames && !(out->index[j].flags & DFVFF_FRAME_KEY); j++);
+
+          size = out->index[j-1].offset + out->index[j-1].size - offset;
+
+          if (size > max_size) {
+               u8 *buffer = realloc( data, size );
+
+               if (!buffer) {
+                    fprintf( stderr, "Failed to allocate compressed frames!\n" );
+                    ret = DFB_NOSYSTEMMEMORY;
+                    goto out;
+               }
+
+               data     = buffer;
+               max_size = size;
+          }
+
+          if (pread( out->fd, data, size, offset ) != (ssize_t) size) {
+               fprintf( stderr, "Failed to read compressed frames!\n" );
+               ret = DFB_IO;
+               goto out;
+          }
+
+          /* Encoded frames are read from memory, so that only decoding is measured. */
+          start = direct_clock_get_micros();
+
+          for (k = i; k < j; k++) {
+               const DFVFFFrameEntry *entry = &out->index[k];
+
+               /* The previous frame is shown again. */
+               if (entry->flags & DFVFF_FRAME_REPEAT)
+                    continue;
+
+               if (!rle_decode( data + entry->offset - offset, entry->size, frame, out->layout.frame_size,
+                                !(entry->flags & DFVFF_FRAME_KEY) )) {
+                    fprintf( stderr, "Failed to decode frame %lu!\n", k );
+                    ret = DFB_FAILURE;
+                    goto out;
+               }
+          }
+
+          decode_time += direct_clock_get_micros() - start;
+     }
+
+     decode_time = MAX( decode_time, 1 );
+
+     fprintf( stderr, "%s: %lu frames, %d bytes per frame\n", out->filename ?: "standard output", out->num_frames,
+              out->layout.frame_size );
+     fprintf( stderr, "  -> decoding: %.1f fps, %.1f MB/s of frames (one thread)\n",
+              out->num_frames * 1000000.0 / decode_time,
+              out->num_frames * (double) out->layout.frame_size / decode_time );
+     fprintf( stderr, "  -> reading at %.2f fps: %.1f MB/s uncompressed, %.1f MB/s compressed\n", rate,
+              rate * out->layout.frame_size / 1000000.0,
+              out->num_frames ? rate * length / out->num_frames / 1000000.0 : 0.0 );
+
+out:
+     free( frame );
+     free( data );
+
+     return ret;
+}
+
+static DFBResult close_output( Output *out )
+{
+     if (out->padding)
+          free( out->padding );
+
+     free( out->index );
+     free( out->previous );
+     free( out->difference );
+     free( out->packed );
+     free( out->repeats );
+
+     if (out->filename && out->fd >= 0 && close( out->fd )) {
+          fprintf( stderr, "Failed to write '%s'!\n", out->filename );
+          return DFB_IO;
+     }
+
+     return DFB_OK;
+}
+
 int main( int argc, char *argv[] )
 {
-     int                    i, j;
+     int                    i;
+     int                    num_outputs = 0;
+     int                    num_open    = 0;
+     DFBResult              ret         = DFB_OK;
      DFBSurfaceDescription  desc;
-     void                  *handle;
+     VideoInput             input;
+     OutputSpec             specs[MAX_VARIANTS+1];
+     Output                 outputs[MAX_VARIANTS+1];
 
      /* Parse the command line. */
      if (!parse_command_line( argc, argv ))
           return -1;
 
-     handle = load_video( &desc );
-     if (!handle)
+     if (load_video( &input, &desc ))
           return -2;
 
-     for (i = 0; i < D_ARRAY_SIZE(format_names); i++) {
-          if (format_names[i].format == desc.pixelformat) {
-               for (j = 0; j < D_ARRAY_SIZE(colorspace_names); j++) {
-                    if (colorspace_names[j].colorspace == desc.colorspace) {
-                         DEBUG( "Writing video (%lu frames): %dx%d, %s (%s), %u/%u fps\n", nframes,
-                                desc.width, desc.height, format_names[i].name, colorspace_names[j].name,
-                                fps_num, fps_den );
-                         break;
-                    }
-               }
+     if (input.fp && num_variants) {
+          fprintf( stderr, "Several outputs are only supported for decoded input video!\n" );
+          ret = DFB_UNSUPPORTED;
+          goto out;
+     }
+
+     /* The main output, unless only variants are written to files. */
+     if (!num_variants || output) {
+          specs[num_outputs].filename   = output;
+          specs[num_outputs].format     = desc.pixelformat;
+          specs[num_outputs].width      = desc.width;
+          specs[num_outputs].height     = desc.height;
+          specs[num_outputs].colorspace = desc.colorspace;
+          num_outputs++;
+     }
+
+     /* Variants default to the settings of the main output. */
+     for (i = 0; i < num_variants; i++) {
+          specs[num_outputs].filename   = variants[i].filename;
+          specs[num_outputs].format     = variants[i].format     ?: desc.pixelformat;
+          specs[num_outputs].width      = variants[i].width      ?: desc.width;
+          specs[num_outputs].height     = variants[i].height     ?: desc.height;
+          specs[num_outputs].colorspace = variants[i].colorspace ?: desc.colorspace;
+          num_outputs++;
+     }
+
+     for (num_open = 0; num_open < num_outputs; num_open++) {
+          ret = open_output( &outputs[num_open], &specs[num_open] );
+          if (ret) {
+               num_open++;
+               goto out;
           }
      }
 
-     header.width      = desc.width;
-     header.height     = desc.height;
-     header.format     = desc.pixelformat;
-     header.colorspace = desc.colorspace;
+     ret = write_frames( &input, &desc, outputs, num_outputs );
+
+     for (i = 0; i < num_outputs && !ret; i++) {
+          ret = finish_output( &outputs[i] );
 
-     header.framerate_num = fps_num;
-     header.framerate_den = fps_den;
+          if (!ret && benchmark)
+               ret = run_benchmark( &outputs[i] );
+     }
 
-     fwrite( &header, sizeof(header), 1, stdout );
+out:
+     for (i = 0; i < num_open; i++) {
+          if (close_output( &outputs[i] ))
+               ret = DFB_IO;
+     }
 
-     write_frames( handle, &desc );
+     close_video( &input );
 
      free( desc.preallocated[0].data );
 
-     return 0;
+     return ret ? -3 : 0;
 }
@@ -16,22 +16,49 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
-#include <dgiff.h>
+#include <dgiffext.h>
+#include <direct/clock.h>
+#include <direct/filesystem.h>
+#include <direct/utf8.h>
+#include <direct/util.h>
 #include <directfb_strings.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include <glyphrow.h>
+#include <math.h>
+#include <unistd.h>
 
 #define MAX_SIZE_COUNT  256
+#define MAX_FONT_COUNT   16
 #define MAX_ROW_WIDTH  2047
+#define MAX_PAGE_SIZE  8192
+
+#define BENCHMARK_LOOPS  1000
+
+#define MAX_KERNING_GLYPHS  8192
+
+#define SDF_SHIFT   3
+#define SDF_SCALE   (1 << SDF_SHIFT)
+#define SDF_SPREAD  4
 
 static const DirectFBPixelFormatNames(format_names);
 
-static const char            *filename      = NULL;
+static const char            *filenames[MAX_FONT_COUNT];
+static int                    font_count    = 0;
 static bool                   debug         = false;
 static DFBSurfacePixelFormat  format        = DSPF_A8;
 static bool                   premultiplied = false;
 static int                    size_count    = 0;
 static int                    face_sizes[MAX_SIZE_COUNT];
+static bool                   index_table   = false;
+static bool                   benchmark     = false;
+static bool                   kerning       = false;
+static int                    sdf_size      = 0;
+static bool                   report        = false;
+static int                    pixel_shift   = 6;
+static bool                   directory     = false;
+static int                    row_width     = MAX_ROW_WIDTH;
+static int                    page_width    = 0;
+static int                    page_height   = 0;
+static const char            *corpus        = NULL;
 
 #define DEBUG(...)                             \
      do {                                      \
@@ -46,12 +73,22 @@ static void print_usage()
      int i = 0;
 
      fprintf( stderr, "DirectFB Glyph Image File Format Tool\n\n" );
-     fprintf( stderr, "Usage: mkdgiff [options] <font>\n\n" );
+     fprintf( stderr, "Usage: mkdgiff [options] <font> [<fallback font>...]\n\n" );
      fprintf( stderr, "Options:\n\n" );
      fprintf( stderr, "  -d, --debug                      Output debug information.\n" );
      fprintf( stderr, "  -f, --format      <pixelformat>  Choose the pixel format (default A8).\n" );
      fprintf( stderr, "  -s, --sizes       <s1>[,s2...]   Set sizes to generate glyph images.\n" );
      fprintf( stderr, "  -p, --premultiply                Use premultiplied alpha (default false, ARGB/ABGR only).\n" );
+     fprintf( stderr, "  -i, --index                      Write a glyph lookup index for each face.\n" );
+     fprintf( stderr, "  -b, --benchmark                  Compare glyph loading and lookup with and without index.\n" );
+     fprintf( stderr, "  -k, --kerning                    Write a kerning pair table for each face (all pairs of up to %d glyphs).\n",
+              MAX_KERNING_GLYPHS );
+     fprintf( stderr, "  -S, --sdf         <size>         Write a single signed distance field face (A8 only).\n" );
+     fprintf( stderr, "  -r, --report                     Compare the distance field face with bitmap faces of all sizes.\n" );
+     fprintf( stderr, "  -t, --toc                        Write a face directory after the header (seekable output only).\n" );
+     fprintf( stderr, "  -w, --row-width   <width>        Set the maximum width of glyph rows (default %d).\n", MAX_ROW_WIDTH );
+     fprintf( stderr, "  -P, --page        <width>x<height>  Place glyphs into pages of a fixed size instead of rows.\n" );
+     fprintf( stderr, "  -c, --corpus      <file>         Place glyphs by frequency in a text file (one string per line).\n" );
      fprintf( stderr, "  -h, --help                       Show this help message.\n\n" );
      fprintf( stderr, "Supported pixel formats:\n\n" );
      while (format_names[i].format != DSPF_UNKNOWN) {
@@ -120,6 +157,18 @@ static DFBBoolean parse_sizes( const char *arg )
      return DFB_TRUE;
 }
 
+static DFBBoolean parse_page( const char *arg )
+{
+     if (sscanf( arg, "%dx%d", &page_width, &page_height ) == 2 &&
+         page_width  > 0 && page_width  <= MAX_PAGE_SIZE &&
+         page_height > 0 && page_height <= MAX_PAGE_SIZE)
+          return DFB_TRUE;
+
+     fprintf( stderr, "Invalid page size specified!\n" );
+
+     return DFB_FALSE;
+}
+
 static DFBBoolean parse_command_line( int argc, char *argv[] )
 {
      int n;
@@ -166,15 +215,93 @@ static DFBBoolean parse_command_line( int argc, char *argv[] )
                continue;
           }
 
-          if (filename || access( arg, R_OK )) {
+          if (strcmp( arg, "-i" ) == 0 || strcmp( arg, "--index" ) == 0) {
+               index_table = true;
+               continue;
+          }
+
+          if (strcmp( arg, "-b" ) == 0 || strcmp( arg, "--benchmark" ) == 0) {
+               benchmark = true;
+               continue;
+          }
+
+          if (strcmp( arg, "-k" ) == 0 || strcmp( arg, "--kerning" ) == 0) {
+               kerning = true;
+               continue;
+          }
+
+          if (strcmp( arg, "-S" ) == 0 || strcmp( arg, "--sdf" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               sdf_size = atoi( argv[n] );
+               if (sdf_size <= 0) {
+                    fprintf( stderr, "Invalid distance field size specified!\n" );
+                    return DFB_FALSE;
+               }
+
+               continue;
+          }
+
+          if (strcmp( arg, "-r" ) == 0 || strcmp( arg, "--report" ) == 0) {
+               report = true;
+               continue;
+          }
+
+          if (strcmp( arg, "-t" ) == 0 || strcmp( arg, "--toc" ) == 0) {
+               directory = true;
+               continue;
+          }
+
+          if (strcmp( arg, "-w" ) == 0 || strcmp( arg, "--row-width" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               row_width = atoi( argv[n] );
+               if (row_width <= 0) {
+                    fprintf( stderr, "Invalid row width specified!\n" );
+                    return DFB_FALSE;
+               }
+
+               continue;
+          }
+
+          if (strcmp( arg, "-P" ) == 0 || strcmp( arg, "--page" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               if (!parse_page( argv[n] ))
+                    return DFB_FALSE;
+
+               continue;
+          }
+
+          if (strcmp( arg, "-c" ) == 0 || strcmp( arg, "--corpus" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               corpus = argv[n];
+
+               continue;
+          }
+
+          if (font_count == MAX_FONT_COUNT || access( arg, R_OK )) {
                print_usage();
                return DFB_FALSE;
           }
 
-          filename = arg;
+          filenames[font_count++] = arg;
      }
 
-     if (!filename) {
+     if (!font_count) {
           print_usage();
           return DFB_FALSE;
      }
@@ -184,474 +311,1512 @@ static DFBBoolean parse_command_line( int argc, char *argv[] )
 
 /**********************************************************************************************************************/
 
-static FT_Error write_glyph( DGIFFGlyphInfo *glyph, FT_GlyphSlot slot, void *dst, int pitch )
-{
-     int  y;
-     u8  *src = slot->bitmap.buffer;
+/*
+ * Signed distance field glyphs.
+ *
+ * Glyphs are rendered at SDF_SCALE times the reference size, the distance to the outline is computed on that
+ * bitmap with an exact euclidean distance transform and sampled at the center of each output pixel.
+ */
 
-     DEBUG( "  ->   %s( %p, %p, %p, %d ) <- width %d\n", __FUNCTION__, glyph, slot, dst, pitch, glyph->width );
+#define SDF_INF  1e20f
 
-     for (y = 0; y < glyph->height; y++) {
-          int  i, j, n;
-          u8  *dst8  = dst;
-          u16 *dst16 = dst;
-          u32 *dst32 = dst;
-
-          switch (slot->bitmap.pixel_mode) {
-               case ft_pixel_mode_grays:
-                    switch (format) {
-                         case DSPF_ABGR:
-                         case DSPF_ARGB:
-                              if (premultiplied) {
-                                   for (i = 0; i < glyph->width; i++)
-                                        dst32[i] = (src[i] << 24) | (src[i] << 16) | (src[i] <<  8) | src[i];
-                              }
-                              else {
-                                   for (i = 0; i < glyph->width; i++)
-                                        dst32[i] = (src[i] << 24) | 0xFFFFFF;
-                              }
-                              break;
-                         case DSPF_AiRGB:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst32[i] = ((src[i] ^ 0xFF) << 24) | 0xFFFFFF;
-                              break;
-                         case DSPF_ARGB8565:
-                              for (i = 0, j = -1; i < glyph->width; ++i) {
-                                   u32 d = (src[i] << 16) | 0xFFFF;
-#ifdef WORDS_BIGENDIAN
-                                   dst8[++j] = (d >> 16) & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] =  d        & 0xFF;
-#else
-                                   dst8[++j] =  d        & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] = (d >> 16) & 0xFF;
-#endif
-                              }
-                              break;
-                         case DSPF_ARGB1666:
-                         case DSPF_ARGB6666:
-                              for (i = 0, j = -1; i < glyph->width; ++i) {
-                                   u32 d = (src[i] << 16) | 0x3FFFF;
-#ifdef WORDS_BIGENDIAN
-                                   dst8[++j] = (d >> 16) & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] =  d        & 0xFF;
-#else
-                                   dst8[++j] =  d        & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] = (d >> 16) & 0xFF;
-#endif
-                              }
-                              break;
-                         case DSPF_ARGB4444:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = (src[i] << 8) | 0xFFF;
-                              break;
-                         case DSPF_RGBA4444:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = 0xFFF0 | ((src[i] & 0xF0) >> 4);
-                              break;
-                         case DSPF_ARGB2554:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = (src[i] << 8) | 0x3FFF;
-                              break;
-                         case DSPF_ARGB1555:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = (src[i] << 8) | 0x7FFF;
-                              break;
-                         case DSPF_RGBA5551:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = 0xFFFE | ((src[i] & 0x80) >> 7);
-                              break;
-                         case DSPF_RGBAF88871:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst32[i] = 0xFFFFFF00 | (src[i] & 0xFE);
-                              break;
-                         case DSPF_A8:
-                              memcpy( dst, src, glyph->width );
-                              break;
-                         case DSPF_A4:
-                              for (i = 0, j = 0; i < glyph->width; i += 2, j++)
-                                   dst8[j] = (src[i] & 0xF0) | (src[i+1] >> 4);
-                              break;
-                         case DSPF_A1:
-                              for (i = 0, j = 0; i < glyph->width; ++j) {
-                                   u8 p = 0;
-                                   for (n = 0; n < 8 && i < glyph->width; ++i, ++n)
-                                        p |= (src[i] & 0x80) >> n;
-                                   dst8[j] = p;
-                              }
-                              break;
-                         case DSPF_A1_LSB:
-                              for (i = 0, j = 0; i < glyph->width; ++j) {
-                                   u8 p = 0;
-                                   for (n = 0; n < 8 && i < glyph->width; ++i, ++n)
-                                        p |= (src[i] & 0x80) >> (7 - n);
-                                   dst8[j] = p;
-                              }
-                              break;
-                         default:
-                              fprintf( stderr, "Unsupported format for glyph rendering!\n" );
-                              return FT_Err_Cannot_Render_Glyph;
-                    }
-                    break;
+static void sdf_transform_1d( const float *f, float *d, int *v, float *z, int n )
+{
+     int q;
+     int k = 0;
 
-               case ft_pixel_mode_mono:
-                    switch (format) {
-                         case DSPF_ABGR:
-                         case DSPF_ARGB:
-                              if (premultiplied) {
-                                   for (i = 0; i < glyph->width; i++)
-                                        dst32[i] = (src[i>>3] & (1 << (7 - (i % 8)))) ? 0xFFFFFFFF : 0x00000000;
-                              }
-                              else {
-                                   for (i = 0; i < glyph->width; i++)
-                                        dst32[i] = ((src[i>>3] & (1 << (7 - (i % 8))) ? 0xFF : 0x00) << 24) | 0xFFFFFF;
-                              }
-                              break;
-                         case DSPF_AiRGB:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst32[i] = ((src[i>>3] & (1 << (7 - (i % 8))) ? 0x00 : 0xFF) << 24) | 0xFFFFFF;
-                              break;
-                         case DSPF_ARGB8565:
-                              for (i = 0, j = -1; i < glyph->width; ++i) {
-                                   u32 d = ((src[i>>3] & (1 << (7 - (i % 8))) ? 0xFF : 0x00) << 16) | 0xFFFF;
-#ifdef WORDS_BIGENDIAN
-                                   dst8[++j] = (d >> 16) & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] =  d        & 0xFF;
-#else
-                                   dst8[++j] =  d        & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] = (d >> 16) & 0xFF;
-#endif
-                              }
-                              break;
-                         case DSPF_ARGB1666:
-                         case DSPF_ARGB6666:
-                              for (i = 0, j = -1; i < glyph->width; ++i) {
-                                   u32 d = ((src[i>>3] & (1 << (7 - (i % 8))) ? 0x3F : 0x00) << 18) | 0x3FFFF;
-#ifdef WORDS_BIGENDIAN
-                                   dst8[++j] = (d >> 16) & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] =  d        & 0xFF;
-#else
-                                   dst8[++j] =  d        & 0xFF;
-                                   dst8[++j] = (d >>  8) & 0xFF;
-                                   dst8[++j] = (d >> 16) & 0xFF;
-#endif
-                              }
-                              break;
-                         case DSPF_ARGB4444:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = ((src[i>>3] & (1 << (7 - (i % 8))) ? 0xF : 0x0) << 12) | 0xFFF;
-                              break;
-                         case DSPF_RGBA4444:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = 0xFFF0 | (src[i>>3] & (1 << (7 - (i % 8))) ? 0xF : 0x0);
-                              break;
-                         case DSPF_ARGB2554:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = ((src[i>>3] & (1 << (7 - (i % 8))) ? 0x3 : 0x0) << 14) | 0x3FFF;
-                              break;
-                         case DSPF_ARGB1555:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = ((src[i>>3] & (1 << (7 - (i % 8))) ? 0x1 : 0x0) << 15) | 0x7FFF;
-                              break;
-                         case DSPF_RGBA5551:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst16[i] = 0xFFFE | (src[i>>3] & (1 << (7 - (i % 8))) ? 0x1 : 0x0);
-                              break;
-                         case DSPF_RGBAF88871:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst32[i] = 0xFFFFFF00 | (src[i>>3] & (1 << (7 - (i % 8))) ? 0xFE : 0x0);
-                              break;
-                         case DSPF_A8:
-                              for (i = 0; i < glyph->width; i++)
-                                   dst8[i] = (src[i>>3] & (1 << (7 - (i % 8)))) ? 0xFF : 0x00;
-                              break;
-                         case DSPF_A4:
-                              for (i = 0, j = 0; i < glyph->width; i += 2, j++)
-                                   dst8[j] = (src[i>>3]     & (1 << (7 -  (i      % 8))) ? 0xF0 : 0x00) |
-                                             (src[(i+1)>>3] & (1 << (7 - ((i + 1) % 8))) ? 0x0F : 0x00);
-                              break;
-                         case DSPF_A1:
-                              memcpy( dst, src, DFB_BYTES_PER_LINE(DSPF_A1, glyph->width) );
-                              break;
-                         case DSPF_A1_LSB:
-                              for (i = 0, j = 0; i < glyph->width; ++j) {
-                                   u8 p = 0;
-                                   for (n = 0; n < 8 && i < glyph->width; ++i, ++n)
-                                        p |= ((src[i] >> n) & 1) << (7 - n);
-                                   dst8[j] = p;
-                              }
-                              break;
-                         default:
-                              fprintf( stderr, "Unsupported format for glyph rendering!\n" );
-                              return FT_Err_Cannot_Render_Glyph;
-                    }
-                    break;
+     v[0] = 0;
+     z[0] = -SDF_INF;
+     z[1] =  SDF_INF;
 
-               default:
-                    break;
+     for (q = 1; q < n; q++) {
+          float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
 
+          while (s <= z[k]) {
+               k--;
+               s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
           }
 
-          src += slot->bitmap.pitch;
-          dst += pitch;
+          k++;
+          v[k]   = q;
+          z[k]   = s;
+          z[k+1] = SDF_INF;
      }
 
-     return FT_Err_Ok;
+     for (q = 0, k = 0; q < n; q++) {
+          while (z[k+1] < q)
+               k++;
+
+          d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+     }
 }
 
-static FT_Error do_face( FT_Face face, int size )
-{
-     FT_Error          ret;
-     int               i;
-     FT_ULong          code;
-     FT_UInt           index;
-     DGIFFFaceHeader   faceheader;
-     DGIFFGlyphInfo   *glyphs;
-     DGIFFGlyphRow    *rows;
-     void            **row_data;
-     int               align        = DFB_PIXELFORMAT_ALIGNMENT( format );
-     int               next_face    = sizeof(DGIFFFaceHeader);
-     int               num_glyphs   = 0;
-     int               num_rows     = 1;
-     int               row_index    = 0;
-     int               row_offset   = 0;
-     int               total_height = 0;
+static DFBBoolean sdf_transform( float *grid, int width, int height )
+{
+     int    x, y;
+     int    n = MAX( width, height );
+     float *f = calloc( n, sizeof(float) );
+     float *d = malloc( n * sizeof(float) );
+     float *z = malloc( (n + 1) * sizeof(float) );
+     int   *v = malloc( n * sizeof(int) );
+
+     if (!f || !d || !z || !v) {
+          free( f );
+          free( d );
+          free( z );
+          free( v );
+          return DFB_FALSE;
+     }
 
-     DEBUG( "%s( %p, %d ) <- %ld glyphs\n", __FUNCTION__, face, size, face->num_glyphs );
+     for (x = 0; x < width; x++) {
+          for (y = 0; y < height; y++)
+               f[y] = grid[y * width + x];
 
-     /* Clear to not leak any data into file. */
-     memset( &faceheader, 0, sizeof(faceheader) );
+          sdf_transform_1d( f, d, v, z, height );
 
-     /* Set the desired size. */
-     ret = FT_Set_Char_Size( face, 0, size << 6, 0, 0 );
-     if (ret) {
-          fprintf( stderr, "Could not set pixel size to %d!\n", size );
-          return ret;
+          for (y = 0; y < height; y++)
+               grid[y * width + x] = d[y];
      }
 
-     glyphs   = calloc( face->num_glyphs, sizeof(DGIFFGlyphInfo) );
-     rows     = calloc( face->num_glyphs, sizeof(DGIFFGlyphRow) );
-     row_data = calloc( face->num_glyphs, sizeof(void*) );
+     for (y = 0; y < height; y++) {
+          sdf_transform_1d( grid + y * width, d, v, z, width );
 
-     for (code = FT_Get_First_Char( face, &index ); index; code = FT_Get_Next_Char( face, code, &index )) {
-          FT_GlyphSlot    slot;
-          DGIFFGlyphInfo *glyph = &glyphs[num_glyphs];
-          DGIFFGlyphRow  *row   = &rows[num_rows - 1];
+          memcpy( grid + y * width, d, width * sizeof(float) );
+     }
 
-          DEBUG( "  -> code %3lu - index %3u\n", code, index );
+     free( f );
+     free( d );
+     free( z );
+     free( v );
 
-          if (num_glyphs == face->num_glyphs) {
-               fprintf( stderr, "Actual number of characters is bigger than number of glyphs!\n" );
-               goto out;
-          }
+     return DFB_TRUE;
+}
 
-          ret = FT_Load_Glyph( face, index, FT_LOAD_RENDER );
-          if (ret) {
-               fprintf( stderr, "Could not render glyph for character index %u!\n", index );
-               goto out;
-          }
+/*
+ * Font of highest priority providing a character, the first font is returned if none does.
+ */
+static FT_Face resolve_char( FT_Face *faces, FT_ULong code, FT_UInt *ret_index )
+{
+     int     i;
+     FT_UInt index = 0;
 
-          slot = face->glyph;
+     for (i = 0; i < font_count; i++) {
+          index = FT_Get_Char_Index( faces[i], code );
+          if (index)
+               break;
+     }
 
-          glyph->unicode = code;
-          glyph->width   = slot->bitmap.width;
-          glyph->height  = slot->bitmap.rows;
-          glyph->left    = slot->bitmap_left;
-          glyph->top     = (face->size->metrics.ascender >> 6) - slot->bitmap_top;
-          glyph->advance = slot->advance.x >> 6;
+     if (ret_index)
+          *ret_index = index;
 
-          num_glyphs++;
+     return i < font_count ? faces[i] : faces[0];
+}
 
-          if (row->width > 0 && row->width + glyph->width > MAX_ROW_WIDTH) {
-               num_rows++;
-               row++;
-          }
+/**********************************************************************************************************************/
 
-          row->width += (glyph->width + align) & ~align;
+static void sdf_glyph_info( FT_Face face, FT_GlyphSlot slot, DGIFFGlyphInfo *glyph )
+{
+     int ascender = face->size->metrics.ascender >> pixel_shift;
+     int top      = ascender * SDF_SCALE - slot->bitmap_top;
+     int right    = slot->bitmap_left + slot->bitmap.width;
+     int bottom   = top + slot->bitmap.rows;
+
+     glyph->left    = (slot->bitmap_left >> SDF_SHIFT) - SDF_SPREAD;
+     glyph->top     = (top >> SDF_SHIFT) - SDF_SPREAD;
+     glyph->width   = ((right  + SDF_SCALE - 1) >> SDF_SHIFT) + SDF_SPREAD - glyph->left;
+     glyph->height  = ((bottom + SDF_SCALE - 1) >> SDF_SHIFT) + SDF_SPREAD - glyph->top;
+     glyph->advance = slot->advance.x >> pixel_shift;
+}
 
-          if (row->height < glyph->height)
-               row->height = glyph->height;
-     }
+static FT_Error write_sdf_glyph( FT_Face face, DGIFFGlyphInfo *glyph, FT_GlyphSlot slot, u8 *dst, int pitch )
+{
+     int    x, y;
+     float *inside, *outside;
+     int    ascender = face->size->metrics.ascender >> pixel_shift;
+     int    width    = glyph->width  * SDF_SCALE;
+     int    height   = glyph->height * SDF_SCALE;
+     int    off_x    = slot->bitmap_left - glyph->left * SDF_SCALE;
+     int    off_y    = ascender * SDF_SCALE - slot->bitmap_top - glyph->top * SDF_SCALE;
 
-     for (i = 0; i < num_rows; i++) {
-          DGIFFGlyphRow *row = &rows[i];
+     DEBUG( "  ->   %s( %p, %p, %p, %d ) <- width %d\n", __FUNCTION__, glyph, slot, dst, pitch, glyph->width );
 
-          DEBUG( "  ->   row %d, width %d, height %d\n", i, row->width, row->height );
+     if (!glyph->width || !glyph->height)
+          return FT_Err_Ok;
 
-          total_height += row->height;
+     inside  = malloc( width * height * sizeof(float) );
+     outside = malloc( width * height * sizeof(float) );
+     if (!inside || !outside) {
+          free( inside );
+          free( outside );
+          return FT_Err_Out_Of_Memory;
+     }
 
-          row->pitch = (DFB_BYTES_PER_LINE( format, row->width ) + 7) & ~7;
+     for (y = 0; y < height; y++) {
+          for (x = 0; x < width; x++) {
+               int  sx = x - off_x;
+               int  sy = y - off_y;
+               bool in = false;
 
-          row_data[i] = calloc( row->height, row->pitch );
+               if (sx >= 0 && sx < slot->bitmap.width && sy >= 0 && sy < slot->bitmap.rows) {
+                    const u8 *src = slot->bitmap.buffer + sy * slot->bitmap.pitch;
+
+                    if (slot->bitmap.pixel_mode == ft_pixel_mode_mono)
+                         in = src[sx>>3] & (0x80 >> (sx & 7));
+                    else
+                         in = src[sx] & 0x80;
+               }
 
-          next_face += row->height * row->pitch;
+               inside[y * width + x]  = in ? 0 : SDF_INF;
+               outside[y * width + x] = in ? SDF_INF : 0;
+          }
      }
 
-     DEBUG( "  -> %d glyphs, %d rows, total height %d\n", num_glyphs, num_rows, total_height );
+     /* Squared distances to the nearest inside and to the nearest outside pixel. */
+     if (!sdf_transform( inside, width, height ) || !sdf_transform( outside, width, height )) {
+          free( inside );
+          free( outside );
+          return FT_Err_Out_Of_Memory;
+     }
 
-     next_face += num_glyphs * sizeof(DGIFFGlyphInfo);
-     next_face += num_rows * sizeof(DGIFFGlyphRow);
+     for (y = 0; y < glyph->height; y++) {
+          for (x = 0; x < glyph->width; x++) {
+               int   i = (y * SDF_SCALE + SDF_SCALE / 2) * width + x * SDF_SCALE + SDF_SCALE / 2;
+               float distance;
+               int   value;
 
-     for (i = 0; i < num_glyphs; i++) {
-          DGIFFGlyphInfo *glyph = &glyphs[i];
+               /* Positive inside, in reference size pixels. */
+               if (outside[i] > 0)
+                    distance =  (sqrtf( outside[i] ) - 0.5f) / SDF_SCALE;
+               else
+                    distance = -(sqrtf( inside[i] )  - 0.5f) / SDF_SCALE;
 
-          DEBUG( "  -> reloading character 0x%x (%d)\n", glyph->unicode, i );
+               value = lrintf( 128 + distance * 127 / SDF_SPREAD );
 
-          ret = FT_Load_Char( face, glyph->unicode, FT_LOAD_RENDER );
-          if (ret) {
-               fprintf( stderr, "Could not render glyph for unicode character 0x%x!\n", glyph->unicode );
-               goto out;
+               dst[x] = CLAMP( value, 0, 255 );
           }
 
-          if (row_offset > 0 && row_offset + glyph->width > MAX_ROW_WIDTH) {
-               row_index++;
-               row_offset = 0;
-          }
+          dst += pitch;
+     }
 
-          DEBUG( "  -> row offset %d\n", row_offset );
+     free( inside );
+     free( outside );
 
-          ret = write_glyph( glyph, face->glyph,
-                             row_data[row_index] + DFB_BYTES_PER_LINE( format, row_offset ), rows[row_index].pitch );
-          if (ret) {
-               fprintf( stderr, "Could not write glyph!\n" );
-               goto out;
+     return FT_Err_Ok;
+}
+
+/*
+ * Reference reconstruction of a glyph from its distance field at another size, one pixel wide antialiasing.
+ */
+static u8 sdf_sample( const DGIFFGlyphInfo *glyph, const u8 *data, int pitch, int ascender, float scale,
+                      float x, float y )
+{
+     int   sx, sy, i, j;
+     float fx, fy, value;
+     float v[2][2];
+
+     /* From target pixel center relative to the origin (y up) to distance field pixel coordinates. */
+     x = x / scale - glyph->left - 0.5f;
+     y = (ascender - glyph->top) - y / scale - 0.5f;
+
+     sx = floorf( x );
+     sy = floorf( y );
+     fx = x - sx;
+     fy = y - sy;
+
+     for (j = 0; j < 2; j++) {
+          for (i = 0; i < 2; i++) {
+               if (sx + i < 0 || sx + i >= glyph->width || sy + j < 0 || sy + j >= glyph->height)
+                    v[j][i] = 0;
+               else
+                    v[j][i] = data[(sy + j) * pitch + sx + i];
           }
+     }
 
-          glyph->row    = row_index;
-          glyph->offset = row_offset;
+     value = (v[0][0] * (1 - fx) + v[0][1] * fx) * (1 - fy) + (v[1][0] * (1 - fx) + v[1][1] * fx) * fy;
 
-          row_offset += (glyph->width + align) & ~align;
+     value = 0.5f + (value - 128) * SDF_SPREAD * scale / 127;
+
+     return lrintf( CLAMP( value, 0, 1 ) * 255 );
+}
+
+static int sdf_compare( FT_Face *faces, const DGIFFFaceHeader *faceheader, const DGIFFGlyphInfo *glyphs,
+                        const u32 *glyph_y, const DGIFFGlyphRow *rows, void **row_data, int size,
+                        FT_Int32 load_flags, double *ret_psnr, double *ret_error )
+{
+     int       i, x, y;
+     float     scale      = (float) size / faceheader->size;
+     long long pixels     = 0;
+     double    error      = 0;
+     double    abs_error  = 0;
+     int       width      = 0;
+     int       height     = 0;
+     int       face_bytes = sizeof(DGIFFFaceHeader) + faceheader->num_glyphs * sizeof(DGIFFGlyphInfo);
+
+     for (i = 0; i < font_count; i++) {
+          if (FT_Set_Char_Size( faces[i], 0, size << 6, 0, 0 ))
+               return 0;
      }
 
-     D_ASSERT( row_index == num_rows - 1 );
+     for (i = 0; i < faceheader->num_glyphs; i++) {
+          const DGIFFGlyphInfo *glyph = &glyphs[i];
+          const DGIFFGlyphRow  *row   = &rows[glyph->row];
+          const u8             *data  = row_data[glyph->row] + glyph->offset;
+          FT_UInt               index;
+          FT_Face               face  = resolve_char( faces, glyph->unicode, &index );
+          FT_GlyphSlot          slot  = face->glyph;
 
-     faceheader.next_face   = next_face;
-     faceheader.size        = size;
-     faceheader.ascender    = face->size->metrics.ascender >> 6;
-     faceheader.descender   = face->size->metrics.descender >> 6;
-     faceheader.height      = faceheader.ascender - faceheader.descender + 1;
-     faceheader.max_advance = face->size->metrics.max_advance >> 6;
-     faceheader.pixelformat = format;
-     faceheader.num_glyphs  = num_glyphs;
-     faceheader.num_rows    = num_rows;
+          if (glyph_y)
+               data += glyph_y[i] * row->pitch;
 
-     DEBUG( "  -> ascender %d, descender %d\n", faceheader.ascender, faceheader.descender );
-     DEBUG( "  -> height %d, max advance %d\n", faceheader.height, faceheader.max_advance );
+          if (FT_Load_Glyph( face, index, FT_LOAD_RENDER | load_flags ) ||
+              slot->bitmap.pixel_mode != ft_pixel_mode_grays)
+               continue;
 
-     fwrite( &faceheader, sizeof(faceheader), 1, stdout );
+          for (y = 0; y < slot->bitmap.rows; y++) {
+               for (x = 0; x < slot->bitmap.width; x++) {
+                    int value = sdf_sample( glyph, data, row->pitch, faceheader->ascender, scale,
+                                            slot->bitmap_left + x + 0.5f, slot->bitmap_top - y - 0.5f );
+                    int diff  = value - slot->bitmap.buffer[y * slot->bitmap.pitch + x];
 
-     fwrite( glyphs, sizeof(*glyphs), num_glyphs, stdout );
+                    error     += diff * diff;
+                    abs_error += abs( diff );
+               }
+          }
 
-     for (i = 0; i < num_rows; i++) {
-          DGIFFGlyphRow *row = &rows[i];
+          pixels += slot->bitmap.width * slot->bitmap.rows;
 
-          fwrite( row, sizeof(*row), 1, stdout );
+          /* Size of the bitmap face in A8 with the same row layout. */
+          if (width > 0 && width + slot->bitmap.width > row_width) {
+               face_bytes += sizeof(DGIFFGlyphRow) + height * ((width + 7) & ~7);
+               width       = 0;
+               height      = 0;
+          }
+
+          width += slot->bitmap.width;
 
-          fwrite( row_data[i], row->pitch, row->height, stdout );
+          if (height < slot->bitmap.rows)
+               height = slot->bitmap.rows;
      }
 
-out:
-     for (i = 0; i < num_rows; i++) {
-          if (row_data[i])
-               free( row_data[i] );
+     face_bytes += sizeof(DGIFFGlyphRow) + height * ((width + 7) & ~7);
+
+     if (pixels) {
+          error     /= pixels;
+          abs_error /= pixels;
      }
 
-     free( row_data );
-     free( rows );
-     free( glyphs );
+     *ret_psnr  = error > 0 ? 10 * log10( 255 * 255 / error ) : 99.9;
+     *ret_error = abs_error;
 
-     return ret;
+     return face_bytes;
 }
 
-/**********************************************************************************************************************/
+static void sdf_report( FT_Face *faces, const DGIFFFaceHeader *faceheader, const DGIFFGlyphInfo *glyphs,
+                        const u32 *glyph_y, const DGIFFGlyphRow *rows, void **row_data )
+{
+     int n;
+     int bitmap_bytes = 0;
 
-static DGIFFHeader header = {
-     magic: { 'D', 'G', 'I', 'F', 'F'},
-     major: 0,
-     minor: 0,
-     flags: 0x01,
-};
+     fprintf( stderr, "Distance field face: size %d, %u glyphs, %d bytes\n",
+              faceheader->size, faceheader->num_glyphs, faceheader->next_face );
 
-int main( int argc, char *argv[] )
-{
-     FT_Error   ret;
-     int        i;
-     FT_Library library = NULL;
-     FT_Face    face    = NULL;
+     for (n = 0; n < size_count; n++) {
+          int    face_bytes;
+          double psnr, error, unhinted_psnr, unhinted_error;
 
-     /* Parse the command line. */
-     if (!parse_command_line( argc, argv ))
-          return -1;
+          /* Against the glyphs of the bitmap face, and against unhinted glyphs to leave out hinting effects. */
+          face_bytes = sdf_compare( faces, faceheader, glyphs, glyph_y, rows, row_data, face_sizes[n], 0,
+                                    &psnr, &error );
 
-     if (premultiplied && (format != DSPF_ARGB || format != DSPF_ABGR)) {
-          fprintf( stderr, "Premultiplied alpha only implemented for ARGB or ABGR!\n" );
-          return -2;
+          sdf_compare( faces, faceheader, glyphs, glyph_y, rows, row_data, face_sizes[n], FT_LOAD_NO_HINTING,
+                       &unhinted_psnr, &unhinted_error );
+
+          fprintf( stderr, "  -> size %3d: bitmap face %8d bytes, PSNR %4.1f dB, mean error %5.2f "
+                   "(unhinted: PSNR %4.1f dB, mean error %5.2f)\n",
+                   face_sizes[n], face_bytes, psnr, error, unhinted_psnr, unhinted_error );
+
+          bitmap_bytes += face_bytes;
      }
 
-     if (!size_count) {
-          DEBUG( "Using default font sizes 8, 10, 12, 16, 22, 32\n" );
+     fprintf( stderr, "  -> %d bytes for %d bitmap faces, %d bytes for the distance field face (ratio %.1f)\n",
+              bitmap_bytes, size_count, faceheader->next_face, (float) bitmap_bytes / faceheader->next_face );
+}
 
-          size_count = 6;
+static int compare_index_entries( const void *a, const void *b )
+{
+     const DGIFFIndexEntry *entry_a = a;
+     const DGIFFIndexEntry *entry_b = b;
 
-          face_sizes[0] =  8;
-          face_sizes[1] = 10;
-          face_sizes[2] = 12;
-          face_sizes[3] = 16;
-          face_sizes[4] = 22;
-          face_sizes[5] = 32;
-     }
-     else {
-          DEBUG( "Using font sizes" );
-          for (i = 0; i < size_count - 1; i++)
-               DEBUG( " %d,", face_sizes[i] );
-          DEBUG( " %d\n", face_sizes[size_count-1] );
+     return (entry_a->unicode > entry_b->unicode) - (entry_a->unicode < entry_b->unicode);
+}
+
+static DGIFFIndexHeader *build_index( const DGIFFGlyphInfo *glyphs, int num_glyphs, u32 *ret_size )
+{
+     int               i, n;
+     u32               size;
+     u32              *direct;
+     DGIFFIndexEntry  *sorted;
+     DGIFFIndexHeader *lookup;
+     int               num_sorted = 0;
+
+     for (i = 0; i < num_glyphs; i++) {
+          if (glyphs[i].unicode >= DGIFF_INDEX_DIRECT)
+               num_sorted++;
      }
 
-     header.num_faces = size_count;
+     size = sizeof(DGIFFIndexHeader) + DGIFF_INDEX_DIRECT * sizeof(u32) + num_sorted * sizeof(DGIFFIndexEntry);
 
-     ret = FT_Init_FreeType( &library );
-     if (ret) {
-          fprintf( stderr, "Initialization of the FreeType2 library failed!\n" );
-          goto out;
+     lookup = malloc( size );
+     if (!lookup)
+          return NULL;
+
+     lookup->num_direct = DGIFF_INDEX_DIRECT;
+     lookup->num_sorted = num_sorted;
+
+     direct = (u32*) (lookup + 1);
+     sorted = (DGIFFIndexEntry*) (direct + DGIFF_INDEX_DIRECT);
+
+     for (i = 0; i < DGIFF_INDEX_DIRECT; i++)
+          direct[i] = DGIFF_INDEX_NONE;
+
+     for (i = 0, n = 0; i < num_glyphs; i++) {
+          if (glyphs[i].unicode < DGIFF_INDEX_DIRECT) {
+               direct[glyphs[i].unicode] = i;
+          }
+          else {
+               sorted[n].unicode = glyphs[i].unicode;
+               sorted[n].glyph   = i;
+               n++;
+          }
      }
 
-     ret = FT_New_Face( library, filename, 0, &face );
-     if (ret) {
-          if (ret == FT_Err_Unknown_File_Format)
-               fprintf( stderr, "Unsupported font format!\n" );
+     qsort( sorted, num_sorted, sizeof(DGIFFIndexEntry), compare_index_entries );
+
+     DEBUG( "  -> index with %u direct and %u sorted entries (%u bytes)\n",
+            lookup->num_direct, lookup->num_sorted, size );
+
+     *ret_size = size;
+
+     return lookup;
+}
+
+static u32 index_lookup( const DGIFFIndexHeader *lookup, u32 unicode )
+{
+     const u32             *direct = (const u32*) (lookup + 1);
+     const DGIFFIndexEntry *sorted = (const DGIFFIndexEntry*) (direct + lookup->num_direct);
+     int                    low    = 0;
+     int                    high   = lookup->num_sorted - 1;
+
+     if (unicode < lookup->num_direct)
+          return direct[unicode];
+
+     while (low <= high) {
+          int mid = (low + high) / 2;
+
+          if (sorted[mid].unicode < unicode)
+               low = mid + 1;
+          else if (sorted[mid].unicode > unicode)
+               high = mid - 1;
           else
-               fprintf( stderr, "Failed loading face!\n" );
+               return sorted[mid].glyph;
+     }
 
-          goto out;
+     return DGIFF_INDEX_NONE;
+}
+
+static void run_benchmark( int size, const DGIFFGlyphInfo *glyphs, int num_glyphs, const DGIFFIndexHeader *lookup )
+{
+     int           i, n;
+     long long     start, load_time, lookup_time, index_time;
+     u32          *hash;
+     u32           hash_size = 1;
+     volatile u32  result    = 0;
+
+     if (!num_glyphs)
+          return;
+
+     /* Without index, a loader has to insert each glyph into its own lookup structure (an open addressing hash
+        table here) before being able to look them up. */
+     while (hash_size < 2 * num_glyphs)
+          hash_size <<= 1;
+
+     hash = malloc( hash_size * sizeof(u32) );
+     if (!hash)
+          return;
+
+     start = direct_clock_get_micros();
+
+     for (n = 0; n < BENCHMARK_LOOPS; n++) {
+          for (i = 0; i < hash_size; i++)
+               hash[i] = DGIFF_INDEX_NONE;
+
+          for (i = 0; i < num_glyphs; i++) {
+               u32 h = (glyphs[i].unicode * 2654435761u) & (hash_size - 1);
+
+               while (hash[h] != DGIFF_INDEX_NONE)
+                    h = (h + 1) & (hash_size - 1);
+
+               hash[h] = i;
+          }
      }
 
-     ret = FT_Select_Charmap( face, ft_encoding_unicode );
-     if (ret) {
-          fprintf( stderr, "Couldn't select Unicode encoding, falling back to Latin1!\n" );
+     load_time = direct_clock_get_micros() - start;
 
-          ret = FT_Select_Charmap( face, ft_encoding_latin_1 );
-          if (ret)
-               fprintf( stderr, "Couldn't even select Latin1 encoding!\n" );
+     start = direct_clock_get_micros();
+
+     for (n = 0; n < BENCHMARK_LOOPS; n++) {
+          for (i = 0; i < num_glyphs; i++) {
+               u32 h = (glyphs[i].unicode * 2654435761u) & (hash_size - 1);
+
+               while (glyphs[hash[h]].unicode != glyphs[i].unicode)
+                    h = (h + 1) & (hash_size - 1);
+
+               result += hash[h];
+          }
      }
 
-     fwrite( &header, sizeof(header), 1, stdout );
+     lookup_time = direct_clock_get_micros() - start;
 
-     DEBUG( "Writing font\n" );
-     for (i = 0; i < size_count; i++) {
-          ret = do_face( face, face_sizes[i] );
-          if (ret)
-               goto out;
+     /* With index, the table is used as is from the mapped file. */
+     start = direct_clock_get_micros();
+
+     for (n = 0; n < BENCHMARK_LOOPS; n++) {
+          for (i = 0; i < num_glyphs; i++)
+               result += index_lookup( lookup, glyphs[i].unicode );
      }
 
-out:
-     if (face)
-          FT_Done_Face( face );
+     index_time = direct_clock_get_micros() - start;
+
+     fprintf( stderr, "Size %d, %d glyphs\n", size, num_glyphs );
+     fprintf( stderr, "  -> load: %lld ns without index, none with index\n",
+              load_time * 1000 / BENCHMARK_LOOPS );
+     fprintf( stderr, "  -> lookup: %lld ns/glyph without index, %lld ns/glyph with index\n",
+              lookup_time * 1000 / BENCHMARK_LOOPS / num_glyphs,
+              index_time * 1000 / BENCHMARK_LOOPS / num_glyphs );
+
+     free( hash );
+}
+
+static int compare_kerning_pairs( const void *a, const void *b )
+{
+     const DGIFFKerningPair *pair_a = a;
+     const DGIFFKerningPair *pair_b = b;
+
+     if (pair_a->left != pair_b->left)
+          return (pair_a->left > pair_b->left) - (pair_a->left < pair_b->left);
+
+     return (pair_a->right > pair_b->right) - (pair_a->right < pair_b->right);
+}
+
+static DGIFFKerningHeader *build_kerning( FT_Face face, const DGIFFGlyphInfo *glyphs, int num_glyphs, u32 *ret_size )
+{
+     int                 i, j;
+     FT_UInt            *indices;
+     u32                *chars;
+     DGIFFKerningPair   *pairs;
+     DGIFFKerningHeader *kern;
+     int                 num_chars = 0;
+     int                 num_pairs = 0;
+     int                 max_pairs = 0;
+
+     indices = malloc( MIN( num_glyphs, MAX_KERNING_GLYPHS ) * sizeof(FT_UInt) );
+     chars   = malloc( MIN( num_glyphs, MAX_KERNING_GLYPHS ) * sizeof(u32) );
+     kern    = malloc( sizeof(DGIFFKerningHeader) );
+     if (!indices || !chars || !kern)
+          goto error;
+
+     if (FT_HAS_KERNING( face )) {
+          for (i = 0; i < num_glyphs; i++) {
+               FT_UInt index = FT_Get_Char_Index( face, glyphs[i].unicode );
+
+               /* Characters from fallback fonts are not kerned. */
+               if (!index)
+                    continue;
+
+               if (num_chars < MAX_KERNING_GLYPHS) {
+                    indices[num_chars] = index;
+                    chars[num_chars]   = glyphs[i].unicode;
+               }
+
+               num_chars++;
+          }
+
+          /* Pairs are probed one by one, large character sets would take hours. */
+          if (num_chars > MAX_KERNING_GLYPHS) {
+               fprintf( stderr, "Kerning only the first %d of %d glyphs!\n", MAX_KERNING_GLYPHS, num_chars );
+               num_chars = MAX_KERNING_GLYPHS;
+          }
+
+          for (i = 0; i < num_chars; i++) {
+               for (j = 0; j < num_chars; j++) {
+                    FT_Vector vector;
+
+                    if (FT_Get_Kerning( face, indices[i], indices[j], ft_kerning_default, &vector ))
+                         continue;
+
+                    if (!(vector.x >> pixel_shift) && !(vector.y >> pixel_shift))
+                         continue;
+
+                    if (num_pairs == max_pairs) {
+                         DGIFFKerningHeader *tmp;
+
+                         max_pairs = max_pairs ? max_pairs * 2 : 256;
+
+                         tmp = realloc( kern, sizeof(DGIFFKerningHeader) + max_pairs * sizeof(DGIFFKerningPair) );
+                         if (!tmp)
+                              goto error;
+
+                         kern = tmp;
+                    }
+
+                    pairs = (DGIFFKerningPair*) (kern + 1);
+
+                    pairs[num_pairs].left  = chars[i];
+                    pairs[num_pairs].right = chars[j];
+                    pairs[num_pairs].x     = vector.x >> pixel_shift;
+                    pairs[num_pairs].y     = vector.y >> pixel_shift;
+
+                    num_pairs++;
+               }
+          }
+     }
+     else
+          DEBUG( "  -> no kerning information in face\n" );
+
+     kern->num_pairs = num_pairs;
+
+     qsort( kern + 1, num_pairs, sizeof(DGIFFKerningPair), compare_kerning_pairs );
+
+     DEBUG( "  -> %d kerning pairs\n", num_pairs );
+
+     free( chars );
+     free( indices );
+
+     *ret_size = sizeof(DGIFFKerningHeader) + num_pairs * sizeof(DGIFFKerningPair);
+
+     return kern;
+
+error:
+     if (kern)
+          free( kern );
+
+     if (chars)
+          free( chars );
+
+     if (indices)
+          free( indices );
+
+     return NULL;
+}
+
+static void write_ext( DGIFFExtType type, const void *data, u32 size )
+{
+     DGIFFExtHeader ext;
+
+     ext.type = type;
+     ext.size = size;
+
+     fwrite( &ext, sizeof(ext), 1, stdout );
+
+     if (size)
+          fwrite( data, size, 1, stdout );
+}
+
+/*
+ * Text corpus.
+ *
+ * The strings of the corpus are kept as code points to measure the number of rows touched by each of them, the
+ * number of occurrences of each code point is used to place the most frequent glyphs first.
+ */
+
+typedef struct {
+     u32 unicode;
+     u32 count;
+} CorpusChar;
+
+static u32        *corpus_text        = NULL;
+static int        *corpus_strings     = NULL; /* offsets of the strings in corpus_text, num_corpus_strings + 1 */
+static int         num_corpus_strings = 0;
+static CorpusChar *corpus_chars       = NULL; /* sorted by unicode value */
+static int         num_corpus_chars   = 0;
+
+static int compare_unicode( const void *a, const void *b )
+{
+     const u32 *unicode_a = a;
+     const u32 *unicode_b = b;
+
+     return (*unicode_a > *unicode_b) - (*unicode_a < *unicode_b);
+}
+
+static DFBBoolean load_corpus()
+{
+     DFBResult       ret;
+     DirectFile      file;
+     DirectFileInfo  info;
+     const u8       *data    = NULL;
+     u32            *sorted  = NULL;
+     DFBBoolean      result  = DFB_FALSE;
+     int             length  = 0;
+     int             n;
+     size_t          i;
+
+     ret = direct_file_open( &file, corpus, O_RDONLY, 0 );
+     if (ret) {
+          fprintf( stderr, "Failed to open '%s'!\n", corpus );
+          return DFB_FALSE;
+     }
+
+     ret = direct_file_get_info( &file, &info );
+     if (ret) {
+          fprintf( stderr, "Failed during get_info() of '%s'!\n", corpus );
+          goto out;
+     }
+
+     if (info.size) {
+          ret = direct_file_map( &file, NULL, 0, info.size, DFP_READ, (void**) &data );
+          if (ret) {
+               fprintf( stderr, "Failed during mmap() of '%s'!\n", corpus );
+               goto out;
+          }
+     }
+
+     /* There are at most as many code points as bytes, and as many strings as bytes plus one. */
+     corpus_text    = malloc( (info.size + 1) * sizeof(u32) );
+     corpus_strings = malloc( (info.size + 2) * sizeof(int) );
+     if (!corpus_text || !corpus_strings) {
+          fprintf( stderr, "Could not allocate corpus!\n" );
+          goto out;
+     }
+
+     corpus_strings[0] = 0;
+
+     for (i = 0; i < info.size; i += DIRECT_UTF8_SKIP( data[i] )) {
+          unichar c;
+
+          if (data[i] == '\n') {
+               if (length > corpus_strings[num_corpus_strings])
+                    corpus_strings[++num_corpus_strings] = length;
+               continue;
+          }
+
+          if (data[i] == '\r')
+               continue;
+
+          /* Ignore invalid and truncated sequences. */
+          if (i + DIRECT_UTF8_SKIP( data[i] ) > info.size)
+               break;
+
+          c = DIRECT_UTF8_GET_CHAR( &data[i] );
+          if (c == (unichar) -1)
+               continue;
+
+          corpus_text[length++] = c;
+     }
+
+     if (length > corpus_strings[num_corpus_strings])
+          corpus_strings[++num_corpus_strings] = length;
+
+     /* Count the occurrences of each code point. */
+     sorted = malloc( (length ?: 1) * sizeof(u32) );
+     corpus_chars = malloc( (length ?: 1) * sizeof(CorpusChar) );
+     if (!sorted || !corpus_chars) {
+          fprintf( stderr, "Could not allocate corpus!\n" );
+          goto out;
+     }
+
+     memcpy( sorted, corpus_text, length * sizeof(u32) );
+
+     qsort( sorted, length, sizeof(u32), compare_unicode );
+
+     for (n = 0; n < length; n++) {
+          if (num_corpus_chars && corpus_chars[num_corpus_chars-1].unicode == sorted[n]) {
+               corpus_chars[num_corpus_chars-1].count++;
+          }
+          else {
+               corpus_chars[num_corpus_chars].unicode = sorted[n];
+               corpus_chars[num_corpus_chars].count   = 1;
+               num_corpus_chars++;
+          }
+     }
+
+     DEBUG( "Corpus with %d strings, %d characters, %d distinct\n", num_corpus_strings, length, num_corpus_chars );
+
+     result = DFB_TRUE;
+
+out:
+     if (sorted)
+          free( sorted );
+
+     if (data)
+          direct_file_unmap( (void*) data, info.size );
+
+     direct_file_close( &file );
+
+     return result;
+}
+
+static u32 corpus_count( u32 unicode )
+{
+     const CorpusChar *chr = bsearch( &unicode, corpus_chars, num_corpus_chars, sizeof(CorpusChar), compare_unicode );
+
+     return chr ? chr->count : 0;
+}
+
+static void free_corpus()
+{
+     if (corpus_chars)
+          free( corpus_chars );
+
+     if (corpus_strings)
+          free( corpus_strings );
+
+     if (corpus_text)
+          free( corpus_text );
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Glyph placement.
+ *
+ * Glyphs are placed in the given order, one after the other into rows of up to row_width pixels, or in shelves
+ * stacked from the top of each page in page mode.
+ */
+
+typedef struct {
+     DGIFFGlyphRow *rows;
+     int            num_rows;
+     int            max_rows;
+     int            shelf_x;
+     int            shelf_y;
+     int            shelf_height;
+} GlyphLayout;
+
+static DFBBoolean layout_init( GlyphLayout *layout )
+{
+     memset( layout, 0, sizeof(GlyphLayout) );
+
+     layout->rows = calloc( 16, sizeof(DGIFFGlyphRow) );
+     if (!layout->rows)
+          return DFB_FALSE;
+
+     layout->num_rows = 1;
+     layout->max_rows = 16;
+
+     return DFB_TRUE;
+}
+
+static DGIFFGlyphRow *layout_next_row( GlyphLayout *layout )
+{
+     if (layout->num_rows == layout->max_rows) {
+          DGIFFGlyphRow *tmp = realloc( layout->rows, 2 * layout->max_rows * sizeof(DGIFFGlyphRow) );
+
+          if (!tmp)
+               return NULL;
+
+          memset( tmp + layout->max_rows, 0, layout->max_rows * sizeof(DGIFFGlyphRow) );
+
+          layout->rows      = tmp;
+          layout->max_rows *= 2;
+     }
+
+     layout->shelf_x      = 0;
+     layout->shelf_y      = 0;
+     layout->shelf_height = 0;
+
+     return &layout->rows[layout->num_rows++];
+}
+
+static FT_Error layout_glyph( GlyphLayout *layout, DGIFFGlyphInfo *glyph, u32 *ret_y )
+{
+     DGIFFGlyphRow *row   = &layout->rows[layout->num_rows - 1];
+     int            align = DFB_PIXELFORMAT_ALIGNMENT( format );
+
+     if (page_width) {
+          if (glyph->width > page_width || glyph->height > page_height) {
+               fprintf( stderr, "Glyph for character 0x%x does not fit into a page!\n", glyph->unicode );
+               return FT_Err_Invalid_Pixel_Size;
+          }
+
+          if (layout->shelf_x > 0 && layout->shelf_x + glyph->width > page_width) {
+               layout->shelf_y      += layout->shelf_height;
+               layout->shelf_x       = 0;
+               layout->shelf_height  = 0;
+          }
+
+          if (layout->shelf_y + glyph->height > page_height && !layout_next_row( layout )) {
+               fprintf( stderr, "Could not allocate glyph pages!\n" );
+               return FT_Err_Out_Of_Memory;
+          }
+
+          glyph->row    = layout->num_rows - 1;
+          glyph->offset = layout->shelf_x;
+
+          if (ret_y)
+               *ret_y = layout->shelf_y;
+
+          layout->shelf_x += (glyph->width + align) & ~align;
+
+          if (layout->shelf_height < glyph->height)
+               layout->shelf_height = glyph->height;
+
+          return FT_Err_Ok;
+     }
+
+     if (row->width > 0 && row->width + glyph->width > row_width) {
+          row = layout_next_row( layout );
+          if (!row) {
+               fprintf( stderr, "Could not allocate glyph rows!\n" );
+               return FT_Err_Out_Of_Memory;
+          }
+     }
+
+     glyph->row    = layout->num_rows - 1;
+     glyph->offset = row->width;
+
+     row->width += (glyph->width + align) & ~align;
+
+     if (row->height < glyph->height)
+          row->height = glyph->height;
+
+     return FT_Err_Ok;
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Corpus report.
+ *
+ * Average number of distinct rows (or pages) touched to render a string of the corpus, with the actual placement
+ * and with the placement in charmap order for comparison.
+ */
+
+static int compare_glyph_unicode( const void *a, const void *b )
+{
+     const DGIFFGlyphInfo *glyph_a = a;
+     const DGIFFGlyphInfo *glyph_b = b;
+
+     return (glyph_a->unicode > glyph_b->unicode) - (glyph_a->unicode < glyph_b->unicode);
+}
+
+static double corpus_rows_touched( const DGIFFGlyphInfo *glyphs, int num_glyphs, int num_rows )
+{
+     int  i, n;
+     int *stamps;
+     u64  touched = 0;
+     int  strings = 0;
+
+     stamps = malloc( num_rows * sizeof(int) );
+     if (!stamps)
+          return 0.0;
+
+     for (i = 0; i < num_rows; i++)
+          stamps[i] = -1;
+
+     for (i = 0; i < num_corpus_strings; i++) {
+          int rows = 0;
+
+          for (n = corpus_strings[i]; n < corpus_strings[i+1]; n++) {
+               const DGIFFGlyphInfo *glyph = bsearch( &corpus_text[n], glyphs, num_glyphs, sizeof(DGIFFGlyphInfo),
+                                                      compare_glyph_unicode );
+
+               if (glyph && stamps[glyph->row] != i) {
+                    stamps[glyph->row] = i;
+                    rows++;
+               }
+          }
+
+          if (rows) {
+               touched += rows;
+               strings++;
+          }
+     }
+
+     free( stamps );
+
+     return strings ? (double) touched / strings : 0.0;
+}
+
+static void corpus_report( int size, const DGIFFGlyphInfo *glyphs, int num_glyphs, int num_rows )
+{
+     int             i;
+     GlyphLayout     layout;
+     DGIFFGlyphInfo *sorted;
+     double          ordered;
+
+     sorted = malloc( (num_glyphs ?: 1) * sizeof(DGIFFGlyphInfo) );
+     if (!sorted)
+          return;
+
+     memcpy( sorted, glyphs, num_glyphs * sizeof(DGIFFGlyphInfo) );
+
+     qsort( sorted, num_glyphs, sizeof(DGIFFGlyphInfo), compare_glyph_unicode );
+
+     ordered = corpus_rows_touched( sorted, num_glyphs, num_rows );
+
+     if (!layout_init( &layout )) {
+          free( sorted );
+          return;
+     }
+
+     for (i = 0; i < num_glyphs; i++) {
+          if (layout_glyph( &layout, &sorted[i], NULL ))
+               goto out;
+     }
+
+     fprintf( stderr, "Size %d, %d strings\n", size, num_corpus_strings );
+     fprintf( stderr, "  -> %.2f rows touched per string (%.2f in charmap order, %d rows, %d in charmap order)\n",
+              ordered, corpus_rows_touched( sorted, num_glyphs, layout.num_rows ), num_rows, layout.num_rows );
+
+out:
+     free( layout.rows );
+     free( sorted );
+}
+
+/**********************************************************************************************************************/
+
+typedef struct {
+     FT_Face  face;
+     FT_ULong code;
+     FT_UInt  index;
+     u32      count;
+} FaceChar;
+
+static int compare_face_chars( const void *a, const void *b )
+{
+     const FaceChar *char_a = a;
+     const FaceChar *char_b = b;
+
+     if (char_a->count != char_b->count)
+          return (char_a->count < char_b->count) - (char_a->count > char_b->count);
+
+     return (char_a->code > char_b->code) - (char_a->code < char_b->code);
+}
+
+static FT_Error do_face( FT_Face *faces, int size, DGIFFFaceEntry *entry )
+{
+     FT_Error            ret;
+     int                 i, n;
+     FT_Face             face         = faces[0];
+     FT_ULong            code;
+     FT_UInt             index;
+     DGIFFFaceHeader     faceheader;
+     DGIFFGlyphInfo     *glyphs;
+     DGIFFGlyphRow      *rows;
+     GlyphLayout         layout;
+     GlyphRowFuncs       funcs;
+     FaceChar           *chars        = NULL;
+     u32                *glyph_y      = NULL;
+     u8                 *row_buffer   = NULL;
+     void              **row_data     = NULL;
+     DGIFFIndexHeader   *lookup       = NULL;
+     u32                 lookup_size  = 0;
+     DGIFFKerningHeader *kern         = NULL;
+     u32                 kern_size    = 0;
+     u64                 next_face    = sizeof(DGIFFFaceHeader);
+     u64                 max_row_size = 0;
+     int                 num_glyphs   = 0;
+     int                 num_chars    = 0;
+     int                 max_chars    = 0;
+     int                 max_advance  = 0;
+     int                 num_rows;
+     int                 total_height = 0;
+     bool                extensions   = index_table || kerning || sdf_size || page_width;
+     FT_Int32            load_flags   = sdf_size ? FT_LOAD_RENDER | FT_LOAD_NO_HINTING : FT_LOAD_RENDER;
+
+     DEBUG( "%s( %p, %d ) <- %ld glyphs\n", __FUNCTION__, face, size, face->num_glyphs );
+
+     /* Clear to not leak any data into file. */
+     memset( &faceheader, 0, sizeof(faceheader) );
+
+     if (!select_row_funcs( &funcs, format, premultiplied ))
+          return FT_Err_Cannot_Render_Glyph;
+
+     /* Set the desired size. */
+     for (i = 0; i < font_count; i++) {
+          ret = FT_Set_Char_Size( faces[i], 0, size << pixel_shift, 0, 0 );
+          if (ret) {
+               fprintf( stderr, "Could not set pixel size to %d!\n", size );
+               return ret;
+          }
+
+          if (max_advance < faces[i]->size->metrics.max_advance)
+               max_advance = faces[i]->size->metrics.max_advance;
+
+          max_chars += faces[i]->num_glyphs;
+     }
+
+     if (!layout_init( &layout ))
+          return FT_Err_Out_Of_Memory;
+
+     glyphs = calloc( max_chars, sizeof(DGIFFGlyphInfo) );
+     chars  = calloc( max_chars, sizeof(FaceChar) );
+     if (page_width)
+          glyph_y = calloc( max_chars, sizeof(u32) );
+
+     if (!glyphs || !chars || (page_width && !glyph_y)) {
+          fprintf( stderr, "Could not allocate glyph tables!\n" );
+          ret = FT_Err_Out_Of_Memory;
+          goto out;
+     }
+
+     /* Each character is taken from the first font providing it. */
+     for (n = 0; n < font_count; n++) {
+          FT_Face font = faces[n];
+
+          for (code = FT_Get_First_Char( font, &index ); index; code = FT_Get_Next_Char( font, code, &index )) {
+               if (n > 0 && resolve_char( faces, code, NULL ) != font)
+                    continue;
+
+               DEBUG( "  -> code %3lu - index %3u (font %d)\n", code, index, n );
+
+               if (num_chars == max_chars) {
+                    fprintf( stderr, "Actual number of characters is bigger than number of glyphs!\n" );
+                    goto out;
+               }
+
+               chars[num_chars].face  = font;
+               chars[num_chars].code  = code;
+               chars[num_chars].index = index;
+               chars[num_chars].count = corpus ? corpus_count( code ) : 0;
+
+               num_chars++;
+          }
+     }
+
+     /* Most frequent characters of the corpus first, then in charmap order. */
+     if (corpus || font_count > 1)
+          qsort( chars, num_chars, sizeof(FaceChar), compare_face_chars );
+
+     /* Compute the layout of the face, glyph images are rendered again row by row when writing. */
+     for (i = 0; i < num_chars; i++) {
+          FT_GlyphSlot    slot;
+          DGIFFGlyphInfo *glyph = &glyphs[num_glyphs];
+
+          code  = chars[i].code;
+          index = chars[i].index;
+
+          ret = FT_Load_Glyph( chars[i].face, index, load_flags );
+          if (ret) {
+               fprintf( stderr, "Could not render glyph for character index %u!\n", index );
+               goto out;
+          }
+
+          slot = chars[i].face->glyph;
+
+          glyph->unicode = code;
+
+          if (sdf_size && slot->bitmap.width && slot->bitmap.rows) {
+               sdf_glyph_info( face, slot, glyph );
+          }
+          else if (sdf_size) {
+               glyph->advance = slot->advance.x >> pixel_shift;
+          }
+          else {
+               glyph->width   = slot->bitmap.width;
+               glyph->height  = slot->bitmap.rows;
+               glyph->left    = slot->bitmap_left;
+               glyph->top     = (face->size->metrics.ascender >> 6) - slot->bitmap_top;
+               glyph->advance = slot->advance.x >> 6;
+          }
+
+          ret = layout_glyph( &layout, glyph, glyph_y ? &glyph_y[num_glyphs] : NULL );
+          if (ret)
+               goto out;
+
+          num_glyphs++;
+     }
+
+     rows     = layout.rows;
+     num_rows = layout.num_rows;
+
+     if (page_width) {
+          for (i = 0; i < num_rows; i++) {
+               rows[i].width  = page_width;
+               rows[i].height = page_height;
+          }
+     }
+
+     for (i = 0; i < num_rows; i++) {
+          DGIFFGlyphRow *row = &rows[i];
+
+          DEBUG( "  ->   row %d, width %d, height %d\n", i, row->width, row->height );
+
+          total_height += row->height;
+
+          row->pitch = (DFB_BYTES_PER_LINE( format, row->width ) + 7) & ~7;
+
+          if (max_row_size < (u64) row->height * row->pitch)
+               max_row_size = (u64) row->height * row->pitch;
+
+          next_face += (u64) row->height * row->pitch;
+     }
+
+     DEBUG( "  -> %d glyphs, %d rows, total height %d\n", num_glyphs, num_rows, total_height );
+
+     next_face += num_glyphs * sizeof(DGIFFGlyphInfo);
+     next_face += num_rows * sizeof(DGIFFGlyphRow);
+
+     if (index_table || benchmark) {
+          lookup = build_index( glyphs, num_glyphs, &lookup_size );
+          if (!lookup) {
+               fprintf( stderr, "Could not allocate glyph index!\n" );
+               ret = FT_Err_Out_Of_Memory;
+               goto out;
+          }
+
+          if (benchmark)
+               run_benchmark( size, glyphs, num_glyphs, lookup );
+     }
+
+     if (kerning) {
+          kern = build_kerning( face, glyphs, num_glyphs, &kern_size );
+          if (!kern) {
+               fprintf( stderr, "Could not allocate kerning table!\n" );
+               ret = FT_Err_Out_Of_Memory;
+               goto out;
+          }
+     }
+
+     if (index_table)
+          next_face += sizeof(DGIFFExtHeader) + lookup_size;
+
+     if (kerning)
+          next_face += sizeof(DGIFFExtHeader) + kern_size;
+
+     if (sdf_size)
+          next_face += sizeof(DGIFFExtHeader) + sizeof(DGIFFDistanceField);
+
+     if (page_width)
+          next_face += sizeof(DGIFFExtHeader) + num_glyphs * sizeof(u32);
+
+     if (extensions)
+          next_face += sizeof(DGIFFExtHeader);
+
+     if (next_face > 0x7FFFFFFF) {
+          fprintf( stderr, "Face of size %d is too big (%llu bytes)!\n", size, (unsigned long long) next_face );
+          ret = FT_Err_Array_Too_Large;
+          goto out;
+     }
+
+     /* The distance field report needs all glyph images, otherwise only one row is kept in memory. */
+     if (sdf_size && report) {
+          row_data = calloc( num_rows, sizeof(void*) );
+          if (!row_data) {
+               fprintf( stderr, "Could not allocate glyph rows!\n" );
+               ret = FT_Err_Out_Of_Memory;
+               goto out;
+          }
+     }
+     else {
+          row_buffer = malloc( max_row_size ?: 1 );
+          if (!row_buffer) {
+               fprintf( stderr, "Could not allocate %llu bytes for glyph row!\n",
+                        (unsigned long long) max_row_size );
+               ret = FT_Err_Out_Of_Memory;
+               goto out;
+          }
+     }
+
+     faceheader.next_face   = next_face;
+     faceheader.size        = size;
+     faceheader.ascender    = face->size->metrics.ascender >> pixel_shift;
+     faceheader.descender   = face->size->metrics.descender >> pixel_shift;
+     faceheader.height      = faceheader.ascender - faceheader.descender + 1;
+     faceheader.max_advance = max_advance >> pixel_shift;
+     faceheader.pixelformat = format;
+     faceheader.num_glyphs  = num_glyphs;
+     faceheader.num_rows    = num_rows;
+
+     DEBUG( "  -> ascender %d, descender %d\n", faceheader.ascender, faceheader.descender );
+     DEBUG( "  -> height %d, max advance %d\n", faceheader.height, faceheader.max_advance );
+
+     entry->size        = size;
+     entry->length      = next_face;
+     entry->pixelformat = format;
+
+     fwrite( &faceheader, sizeof(faceheader), 1, stdout );
+
+     fwrite( glyphs, sizeof(*glyphs), num_glyphs, stdout );
+
+     for (i = 0, n = 0; i < num_rows; i++) {
+          DGIFFGlyphRow *row  = &rows[i];
+          u8            *data = row_buffer;
+
+          if (row_data) {
+               data = row_data[i] = calloc( row->height, row->pitch );
+               if (!data && row->height && row->pitch) {
+                    fprintf( stderr, "Could not allocate glyph row!\n" );
+                    ret = FT_Err_Out_Of_Memory;
+                    goto out;
+               }
+          }
+          else
+               memset( data, 0, row->height * row->pitch );
+
+          for (; n < num_glyphs && glyphs[n].row == i; n++) {
+               DGIFFGlyphInfo *glyph = &glyphs[n];
+               u8             *dst   = data + (glyph_y ? glyph_y[n] * row->pitch : 0);
+
+               DEBUG( "  -> reloading character 0x%x (%d)\n", glyph->unicode, n );
+
+               ret = FT_Load_Glyph( chars[n].face, chars[n].index, load_flags );
+               if (ret) {
+                    fprintf( stderr, "Could not render glyph for unicode character 0x%x!\n", glyph->unicode );
+                    goto out;
+               }
+
+               DEBUG( "  -> row offset %d\n", glyph->offset );
+
+               if (sdf_size)
+                    ret = write_sdf_glyph( face, glyph, chars[n].face->glyph, dst + glyph->offset, row->pitch );
+               else
+                    ret = write_glyph( &funcs, glyph, chars[n].face->glyph,
+                                       dst + DFB_BYTES_PER_LINE( format, glyph->offset ), row->pitch );
+               if (ret) {
+                    fprintf( stderr, "Could not write glyph!\n" );
+                    goto out;
+               }
+          }
+
+          fwrite( row, sizeof(*row), 1, stdout );
+
+          fwrite( data, row->pitch, row->height, stdout );
+     }
+
+     D_ASSERT( n == num_glyphs );
+
+     if (index_table)
+          write_ext( DGIFF_EXT_INDEX, lookup, lookup_size );
+
+     if (kerning)
+          write_ext( DGIFF_EXT_KERN, kern, kern_size );
+
+     if (sdf_size) {
+          DGIFFDistanceField sdf;
+
+          sdf.spread = SDF_SPREAD;
+
+          write_ext( DGIFF_EXT_SDF, &sdf, sizeof(sdf) );
+     }
+
+     if (page_width)
+          write_ext( DGIFF_EXT_PAGE, glyph_y, num_glyphs * sizeof(u32) );
+
+     if (extensions)
+          write_ext( DGIFF_EXT_END, NULL, 0 );
+
+     if (sdf_size && report)
+          sdf_report( faces, &faceheader, glyphs, glyph_y, rows, row_data );
+
+     if (corpus)
+          corpus_report( size, glyphs, num_glyphs, num_rows );
+
+out:
+     if (row_data) {
+          for (i = 0; i < num_rows; i++) {
+               if (row_data[i])
+                    free( row_data[i] );
+          }
+
+          free( row_data );
+     }
+
+     if (row_buffer)
+          free( row_buffer );
+
+     if (kern)
+          free( kern );
+
+     if (lookup)
+          free( lookup );
+
+     if (glyph_y)
+          free( glyph_y );
+
+     if (chars)
+          free( chars );
+
+     free( layout.rows );
+     free( glyphs );
+
+     return ret;
+}
+
+/**********************************************************************************************************************/
+
+static DGIFFHeader header = {
+     magic: { 'D', 'G', 'I', 'F', 'F'},
+     major: 0,
+     minor: 0,
+     flags: 0x01,
+};
+
+int main( int argc, char *argv[] )
+{
+     FT_Error        ret;
+     int             i;
+     int             num_faces;
+     const int      *sizes;
+     u64             offset;
+     FT_Library      library = NULL;
+     FT_Face         faces[MAX_FONT_COUNT] = { NULL };
+     DGIFFFaceEntry *entries = NULL;
+
+     /* Parse the command line. */
+     if (!parse_command_line( argc, argv ))
+          return -1;
+
+     if (sdf_size && format != DSPF_A8) {
+          fprintf( stderr, "Signed distance field only implemented for A8!\n" );
+          return -2;
+     }
+
+     if (premultiplied && (format != DSPF_ARGB || format != DSPF_ABGR)) {
+          fprintf( stderr, "Premultiplied alpha only implemented for ARGB or ABGR!\n" );
+          return -2;
+     }
+
+     if (!size_count) {
+          DEBUG( "Using default font sizes 8, 10, 12, 16, 22, 32\n" );
+
+          size_count = 6;
+
+          face_sizes[0] =  8;
+          face_sizes[1] = 10;
+          face_sizes[2] = 12;
+          face_sizes[3] = 16;
+          face_sizes[4] = 22;
+          face_sizes[5] = 32;
+     }
+     else {
+          DEBUG( "Using font sizes" );
+          for (i = 0; i < size_count - 1; i++)
+               DEBUG( " %d,", face_sizes[i] );
+          DEBUG( " %d\n", face_sizes[size_count-1] );
+     }
+
+     if (sdf_size) {
+          DEBUG( "Using signed distance field size %d\n", sdf_size );
+
+          pixel_shift = 6 + SDF_SHIFT;
+
+          num_faces = 1;
+          sizes     = &sdf_size;
+     }
+     else {
+          num_faces = size_count;
+          sizes     = face_sizes;
+     }
+
+     header.num_faces = num_faces;
+
+     if (directory) {
+          /* The directory is written once all faces are known, check before writing anything. */
+          if (lseek( fileno( stdout ), 0, SEEK_CUR ) < 0) {
+               fprintf( stderr, "Face directory requires a seekable output!\n" );
+               return -2;
+          }
+
+          header.minor  = 1;
+          header.flags |= DGIFF_FLAG_FACE_DIRECTORY;
+     }
+
+     if (page_width) {
+          DEBUG( "Using pages of %dx%d\n", page_width, page_height );
+
+          header.minor  = 1;
+          header.flags |= DGIFF_FLAG_PAGES;
+     }
+
+     if (corpus && !load_corpus())
+          return -2;
+
+     entries = calloc( num_faces, sizeof(DGIFFFaceEntry) );
+     if (!entries) {
+          fprintf( stderr, "Could not allocate face entries!\n" );
+          free_corpus();
+          return -2;
+     }
+
+     init_row_tables();
+
+     ret = FT_Init_FreeType( &library );
+     if (ret) {
+          fprintf( stderr, "Initialization of the FreeType2 library failed!\n" );
+          goto out;
+     }
+
+     for (i = 0; i < font_count; i++) {
+          DEBUG( "Loading font '%s'\n", filenames[i] );
+
+          ret = FT_New_Face( library, filenames[i], 0, &faces[i] );
+          if (ret) {
+               if (ret == FT_Err_Unknown_File_Format)
+                    fprintf( stderr, "Unsupported font format in '%s'!\n", filenames[i] );
+               else
+                    fprintf( stderr, "Failed loading face from '%s'!\n", filenames[i] );
+
+               goto out;
+          }
+
+          ret = FT_Select_Charmap( faces[i], ft_encoding_unicode );
+          if (ret) {
+               fprintf( stderr, "Couldn't select Unicode encoding, falling back to Latin1!\n" );
+
+               ret = FT_Select_Charmap( faces[i], ft_encoding_latin_1 );
+               if (ret)
+                    fprintf( stderr, "Couldn't even select Latin1 encoding!\n" );
+          }
+     }
+
+     fwrite( &header, sizeof(header), 1, stdout );
+
+     offset = sizeof(header);
+
+     if (directory) {
+          fwrite( entries, sizeof(DGIFFFaceEntry), num_faces, stdout );
+
+          offset += num_faces * sizeof(DGIFFFaceEntry);
+     }
+
+     DEBUG( "Writing font\n" );
+     for (i = 0; i < num_faces; i++) {
+          ret = do_face( faces, sizes[i], &entries[i] );
+          if (ret)
+               goto out;
+
+          entries[i].offset = offset;
+
+          offset += entries[i].length;
+          if (offset > 0x7FFFFFFF) {
+               fprintf( stderr, "Font is too big (%llu bytes)!\n", (unsigned long long) offset );
+               ret = FT_Err_Array_Too_Large;
+               goto out;
+          }
+     }
+
+     if (directory) {
+          DEBUG( "Writing face directory\n" );
+
+          if (fseek( stdout, sizeof(header), SEEK_SET )) {
+               fprintf( stderr, "Could not seek to face directory!\n" );
+               ret = FT_Err_Cannot_Open_Stream;
+               goto out;
+          }
+
+          fwrite( entries, sizeof(DGIFFFaceEntry), num_faces, stdout );
+     }
+
+out:
+     free( entries );
+
+     free_corpus();
+
+     for (i = 0; i < font_count; i++) {
+          if (faces[i])
+               FT_Done_Face( faces[i] );
+     }
 
      if (library)
           FT_Done_FreeType( library );
@@ -0,0 +1,726 @@
+/*
+   This file is part of DirectFB.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include <dfiffext.h>
+#include <direct/utf8.h>
+#include <direct/util.h>
+#include <directfb_strings.h>
+#include <glyphrow.h>
+
+#define MAX_LABEL_COUNT  4096
+#define MAX_FONT_COUNT     16
+#define MAX_ATLAS_WIDTH  2048
+
+static const DirectFBPixelFormatNames(format_names);
+
+static const char            *filename      = NULL;
+static bool                   debug         = false;
+static DFBSurfacePixelFormat  format        = DSPF_A8;
+static bool                   premultiplied = false;
+static const char            *output        = NULL;
+static const char            *index_file    = NULL;
+static int                    atlas_width   = MAX_ATLAS_WIDTH;
+
+#define DEBUG(...)                             \
+     do {                                      \
+          if (debug)                           \
+               fprintf( stderr, __VA_ARGS__ ); \
+     } while (0)
+
+/**********************************************************************************************************************/
+
+static void print_usage()
+{
+     int i = 0;
+
+     fprintf( stderr, "DirectFB Pre-rendered Label Tool\n\n" );
+     fprintf( stderr, "Usage: mkdlabels [options] <labels>\n\n" );
+     fprintf( stderr, "Each line of the labels file is '<name> <font> <size> <pixelformat> <string>', separated by tabs.\n" );
+     fprintf( stderr, "A pixel format of '-' selects the default one, empty lines and lines starting with '#' are ignored.\n" );
+     fprintf( stderr, "Without output directory, all labels are packed into one image written to stdout.\n\n" );
+     fprintf( stderr, "Options:\n\n" );
+     fprintf( stderr, "  -d, --debug                      Output debug information.\n" );
+     fprintf( stderr, "  -f, --format      <pixelformat>  Choose the default pixel format (default A8).\n" );
+     fprintf( stderr, "  -p, --premultiply                Use premultiplied alpha for ARGB/ABGR labels (default false).\n" );
+     fprintf( stderr, "  -o, --output      <directory>    Write one image per label, named after the label.\n" );
+     fprintf( stderr, "  -i, --index       <file>         Write the position of each label in the packed image.\n" );
+     fprintf( stderr, "  -w, --width       <width>        Set the maximum width of the packed image (default %d).\n",
+              MAX_ATLAS_WIDTH );
+     fprintf( stderr, "  -h, --help                       Show this help message.\n\n" );
+     fprintf( stderr, "Supported pixel formats:\n\n" );
+     while (format_names[i].format != DSPF_UNKNOWN) {
+          DFBSurfacePixelFormat format = format_names[i].format;
+          if ( DFB_PIXELFORMAT_HAS_ALPHA ( format ) &&
+              !DFB_PIXELFORMAT_IS_INDEXED( format ) &&
+              !DFB_COLOR_IS_YUV          ( format )) {
+               fprintf( stderr, "  %-10s %2d bits\n", format_names[i].name, DFB_BITS_PER_PIXEL( format ) );
+          }
+          ++i;
+     }
+     fprintf( stderr, "\n" );
+}
+
+static DFBSurfacePixelFormat lookup_format( const char *arg )
+{
+     int i = 0;
+
+     while (format_names[i].format != DSPF_UNKNOWN) {
+          if (!strcasecmp( arg, format_names[i].name )              &&
+               DFB_PIXELFORMAT_HAS_ALPHA ( format_names[i].format ) &&
+              !DFB_PIXELFORMAT_IS_INDEXED( format_names[i].format ) &&
+              !DFB_COLOR_IS_YUV          ( format_names[i].format ))
+               return format_names[i].format;
+          ++i;
+     }
+
+     fprintf( stderr, "Invalid pixel format specified!\n" );
+
+     return DSPF_UNKNOWN;
+}
+
+static DFBBoolean parse_command_line( int argc, char *argv[] )
+{
+     int n;
+
+     for (n = 1; n < argc; n++) {
+          const char *arg = argv[n];
+
+          if (strcmp( arg, "-h" ) == 0 || strcmp( arg, "--help" ) == 0) {
+               print_usage();
+               return DFB_FALSE;
+          }
+
+          if (strcmp( arg, "-d" ) == 0 || strcmp( arg, "--debug" ) == 0) {
+               debug = true;
+               continue;
+          }
+
+          if (strcmp( arg, "-f" ) == 0 || strcmp( arg, "--format" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               format = lookup_format( argv[n] );
+               if (format == DSPF_UNKNOWN)
+                    return DFB_FALSE;
+
+               continue;
+          }
+
+          if (strcmp( arg, "-p" ) == 0 || strcmp( arg, "--premultiply" ) == 0) {
+               premultiplied = true;
+               continue;
+          }
+
+          if (strcmp( arg, "-o" ) == 0 || strcmp( arg, "--output" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               output = argv[n];
+
+               continue;
+          }
+
+          if (strcmp( arg, "-i" ) == 0 || strcmp( arg, "--index" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               index_file = argv[n];
+
+               continue;
+          }
+
+          if (strcmp( arg, "-w" ) == 0 || strcmp( arg, "--width" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return DFB_FALSE;
+               }
+
+               atlas_width = atoi( argv[n] );
+               if (atlas_width <= 0) {
+                    fprintf( stderr, "Invalid width specified!\n" );
+                    return DFB_FALSE;
+               }
+
+               continue;
+          }
+
+          if (filename || access( arg, R_OK )) {
+               print_usage();
+               return DFB_FALSE;
+          }
+
+          filename = arg;
+     }
+
+     if (!filename) {
+          print_usage();
+          return DFB_FALSE;
+     }
+
+     return DFB_TRUE;
+}
+
+/**********************************************************************************************************************/
+
+typedef struct {
+     char                  *name;
+     char                  *font;
+     int                    size;
+     DFBSurfacePixelFormat  format;
+     char                  *text;      /* UTF-8 */
+
+     int                    width;
+     int                    height;
+     int                    baseline;  /* distance from the top of the image to the baseline */
+     u8                    *coverage;  /* width * height 8 bit coverage values */
+
+     int                    x;         /* position in the packed image */
+     int                    y;
+} Label;
+
+typedef struct {
+     const char            *filename;
+     FT_Face                face;
+} LabelFont;
+
+static FT_Library  library     = NULL;
+static LabelFont   fonts[MAX_FONT_COUNT];
+static int         font_count  = 0;
+static Label       labels[MAX_LABEL_COUNT];
+static int         label_count = 0;
+
+static DFBBoolean load_labels()
+{
+     FILE       *fp;
+     char       *line = NULL;
+     size_t      len  = 0;
+     int         num  = 0;
+     DFBBoolean  ret  = DFB_FALSE;
+
+     fp = fopen( filename, "r" );
+     if (!fp) {
+          fprintf( stderr, "Failed to open '%s'!\n", filename );
+          return DFB_FALSE;
+     }
+
+     while (getline( &line, &len, fp ) >= 0) {
+          char  *fields[5];
+          char  *ptr = line;
+          Label *label;
+          int    i;
+
+          num++;
+
+          line[strcspn( line, "\r\n" )] = 0;
+
+          if (!line[0] || line[0] == '#')
+               continue;
+
+          /* The string is the remaining part of the line and may contain tabs. */
+          for (i = 0; i < 4; i++) {
+               fields[i] = ptr;
+
+               ptr = strchr( ptr, '\t' );
+               if (!ptr)
+                    break;
+
+               *ptr++ = 0;
+          }
+
+          if (i < 4) {
+               fprintf( stderr, "%s:%d: missing fields!\n", filename, num );
+               goto out;
+          }
+
+          fields[4] = ptr;
+
+          if (label_count == MAX_LABEL_COUNT) {
+               fprintf( stderr, "Maximum number of labels (%d) exceeded!\n", MAX_LABEL_COUNT );
+               goto out;
+          }
+
+          label = &labels[label_count];
+
+          label->size = atoi( fields[2] );
+          if (label->size <= 0) {
+               fprintf( stderr, "%s:%d: invalid size '%s'!\n", filename, num, fields[2] );
+               goto out;
+          }
+
+          if (strcmp( fields[3], "-" ) == 0) {
+               label->format = format;
+          }
+          else {
+               label->format = lookup_format( fields[3] );
+               if (label->format == DSPF_UNKNOWN) {
+                    fprintf( stderr, "%s:%d: invalid pixel format '%s'!\n", filename, num, fields[3] );
+                    goto out;
+               }
+          }
+
+          /* Names are file names within the output directory. */
+          if (!fields[0][0] || strchr( fields[0], '/' ) || !strcmp( fields[0], "." ) || !strcmp( fields[0], ".." )) {
+               fprintf( stderr, "%s:%d: invalid name '%s'!\n", filename, num, fields[0] );
+               goto out;
+          }
+
+          for (i = 0; i < label_count; i++) {
+               if (!strcmp( labels[i].name, fields[0] )) {
+                    fprintf( stderr, "%s:%d: duplicate name '%s'!\n", filename, num, fields[0] );
+                    goto out;
+               }
+          }
+
+          label->name = strdup( fields[0] );
+          label->font = strdup( fields[1] );
+          label->text = strdup( fields[4] );
+
+          label_count++;
+
+          if (!label->name || !label->font || !label->text) {
+               fprintf( stderr, "Could not allocate label!\n" );
+               goto out;
+          }
+     }
+
+     ret = DFB_TRUE;
+
+out:
+     free( line );
+
+     fclose( fp );
+
+     return ret;
+}
+
+static FT_Face get_font( const char *font )
+{
+     FT_Error  ret;
+     FT_Face   face;
+     int       i;
+
+     for (i = 0; i < font_count; i++) {
+          if (strcmp( fonts[i].filename, font ) == 0)
+               return fonts[i].face;
+     }
+
+     if (font_count == MAX_FONT_COUNT) {
+          fprintf( stderr, "Maximum number of fonts (%d) exceeded!\n", MAX_FONT_COUNT );
+          return NULL;
+     }
+
+     DEBUG( "Loading font '%s'\n", font );
+
+     ret = FT_New_Face( library, font, 0, &face );
+     if (ret) {
+          if (ret == FT_Err_Unknown_File_Format)
+               fprintf( stderr, "Unsupported font format in '%s'!\n", font );
+          else
+               fprintf( stderr, "Failed loading face from '%s'!\n", font );
+
+          return NULL;
+     }
+
+     ret = FT_Select_Charmap( face, ft_encoding_unicode );
+     if (ret) {
+          fprintf( stderr, "Couldn't select Unicode encoding, falling back to Latin1!\n" );
+
+          ret = FT_Select_Charmap( face, ft_encoding_latin_1 );
+          if (ret)
+               fprintf( stderr, "Couldn't even select Latin1 encoding!\n" );
+     }
+
+     fonts[font_count].filename = font;
+     fonts[font_count].face     = face;
+
+     font_count++;
+
+     return face;
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Lay out the string of a label with kerning, either to compute its extents (coverage is NULL) or to accumulate
+ * the coverage of each glyph at the position given by the extents.
+ */
+static FT_Error layout_label( FT_Face face, const Label *label, u8 *coverage, int *ret_left, int *ret_top,
+                              int *ret_right, int *ret_bottom )
+{
+     FT_Error    ret;
+     int         x, y;
+     const char *text     = label->text;
+     FT_Pos      pen      = 0;
+     FT_UInt     prev     = 0;
+     int         ascender = face->size->metrics.ascender >> 6;
+     int         left     = 0;
+     int         top      = 0;
+     int         right    = 0;
+     int         bottom   = ascender - (face->size->metrics.descender >> 6);
+
+     while (*text) {
+          FT_GlyphSlot slot = face->glyph;
+          FT_UInt      index;
+          unichar      c    = DIRECT_UTF8_GET_CHAR( text );
+          int          skip = DIRECT_UTF8_SKIP( *text );
+          int          gx, gy;
+
+          if (strnlen( text, skip ) < skip)
+               break;
+
+          text += skip;
+
+          if (c == (unichar) -1)
+               continue;
+
+          index = FT_Get_Char_Index( face, c );
+
+          if (prev && index && FT_HAS_KERNING( face )) {
+               FT_Vector delta;
+
+               if (!FT_Get_Kerning( face, prev, index, ft_kerning_default, &delta ))
+                    pen += delta.x;
+          }
+
+          ret = FT_Load_Glyph( face, index, FT_LOAD_RENDER );
+          if (ret) {
+               fprintf( stderr, "Could not render glyph for unicode character 0x%x!\n", c );
+               return ret;
+          }
+
+          gx = (pen >> 6) + slot->bitmap_left;
+          gy = ascender - slot->bitmap_top;
+
+          if (coverage) {
+               const u8 *src = slot->bitmap.buffer;
+               u8       *dst = coverage + (gy - *ret_top) * label->width + gx - *ret_left;
+
+               for (y = 0; y < slot->bitmap.rows; y++) {
+                    for (x = 0; x < slot->bitmap.width; x++) {
+                         int value;
+
+                         if (slot->bitmap.pixel_mode == ft_pixel_mode_mono)
+                              value = (src[x>>3] & (0x80 >> (x & 7))) ? 0xFF : 0;
+                         else
+                              value = src[x];
+
+                         /* Overlapping glyphs add up. */
+                         dst[x] = MIN( dst[x] + value, 0xFF );
+                    }
+
+                    src += slot->bitmap.pitch;
+                    dst += label->width;
+               }
+          }
+          else if (slot->bitmap.width && slot->bitmap.rows) {
+               left   = MIN( left,   gx );
+               top    = MIN( top,    gy );
+               right  = MAX( right,  gx + (int) slot->bitmap.width );
+               bottom = MAX( bottom, gy + (int) slot->bitmap.rows );
+          }
+
+          pen  += slot->advance.x;
+          prev  = index;
+     }
+
+     if (!coverage) {
+          *ret_left   = left;
+          *ret_top    = top;
+          *ret_right  = MAX( right, pen >> 6 );
+          *ret_bottom = bottom;
+     }
+
+     return FT_Err_Ok;
+}
+
+static FT_Error render_label( Label *label )
+{
+     FT_Error ret;
+     FT_Face  face;
+     int      left, top, right, bottom;
+
+     DEBUG( "Rendering label '%s' at size %d\n", label->name, label->size );
+
+     face = get_font( label->font );
+     if (!face)
+          return FT_Err_Cannot_Open_Resource;
+
+     ret = FT_Set_Char_Size( face, 0, label->size << 6, 0, 0 );
+     if (ret) {
+          fprintf( stderr, "Could not set pixel size to %d!\n", label->size );
+          return ret;
+     }
+
+     ret = layout_label( face, label, NULL, &left, &top, &right, &bottom );
+     if (ret)
+          return ret;
+
+     label->width    = right - left;
+     label->height   = bottom - top;
+     label->baseline = (face->size->metrics.ascender >> 6) - top;
+
+     label->coverage = calloc( label->width * label->height ?: 1, 1 );
+     if (!label->coverage) {
+          fprintf( stderr, "Could not allocate label!\n" );
+          return FT_Err_Out_Of_Memory;
+     }
+
+     DEBUG( "  -> %dx%d, baseline %d\n", label->width, label->height, label->baseline );
+
+     return layout_label( face, label, label->coverage, &left, &top, &right, &bottom );
+}
+
+/**********************************************************************************************************************/
+
+static DFIFFHeader header = {
+     magic: { 'D', 'F', 'I', 'F', 'F' },
+     major: 0,
+     minor: 0,
+     flags: 0x01
+};
+
+static void write_image( FILE *fp, DFBSurfacePixelFormat format, int width, int height, int pitch, const u8 *data )
+{
+     header.width  = width;
+     header.height = height;
+     header.format = format;
+     header.pitch  = pitch;
+
+     if (premultiplied && (format == DSPF_ARGB || format == DSPF_ABGR))
+          header.flags |= DFIFF_FLAG_PREMULTIPLIED;
+     else
+          header.flags &= ~DFIFF_FLAG_PREMULTIPLIED;
+
+     fwrite( &header, sizeof(header), 1, fp );
+
+     fwrite( data, pitch, height, fp );
+}
+
+static void convert_label( const Label *label, const GlyphRowFuncs *funcs, u8 *dst, int pitch )
+{
+     int y;
+
+     for (y = 0; y < label->height; y++)
+          funcs->gray( label->coverage + y * label->width, dst + y * pitch, label->width );
+}
+
+static DFBBoolean write_labels()
+{
+     int i;
+
+     for (i = 0; i < label_count; i++) {
+          const Label   *label = &labels[i];
+          GlyphRowFuncs  funcs;
+          FILE          *fp;
+          char           path[PATH_MAX];
+          u8            *data;
+          int            pitch = (DFB_BYTES_PER_LINE( label->format, label->width ) + 7) & ~7;
+
+          if (!select_row_funcs( &funcs, label->format, premultiplied ))
+               return DFB_FALSE;
+
+          data = calloc( label->height ?: 1, pitch ?: 1 );
+          if (!data) {
+               fprintf( stderr, "Could not allocate label image!\n" );
+               return DFB_FALSE;
+          }
+
+          convert_label( label, &funcs, data, pitch );
+
+          snprintf( path, sizeof(path), "%s/%s.dfiff", output, label->name );
+
+          fp = fopen( path, "w" );
+          if (!fp) {
+               fprintf( stderr, "Failed to create '%s'!\n", path );
+               free( data );
+               return DFB_FALSE;
+          }
+
+          write_image( fp, label->format, label->width, label->height, pitch, data );
+
+          fclose( fp );
+
+          free( data );
+     }
+
+     return DFB_TRUE;
+}
+
+static int compare_label_heights( const void *a, const void *b )
+{
+     const Label *label_a = *(const Label**) a;
+     const Label *label_b = *(const Label**) b;
+
+     if (label_a->height != label_b->height)
+          return label_b->height - label_a->height;
+
+     return label_b->width - label_a->width;
+}
+
+static DFBBoolean write_atlas()
+{
+     int            i;
+     GlyphRowFuncs  funcs;
+     Label         *sorted[MAX_LABEL_COUNT];
+     u8            *data;
+     int            pitch;
+     int            align        = DFB_PIXELFORMAT_ALIGNMENT( format );
+     int            width        = 0;
+     int            height       = 0;
+     int            shelf_x      = 0;
+     int            shelf_height = 0;
+     FILE          *fp           = NULL;
+
+     for (i = 0; i < label_count; i++) {
+          if (labels[i].format != format) {
+               fprintf( stderr, "All labels of a packed image must use the default pixel format!\n" );
+               return DFB_FALSE;
+          }
+
+          if (labels[i].width > atlas_width) {
+               fprintf( stderr, "Label '%s' is wider than the packed image!\n", labels[i].name );
+               return DFB_FALSE;
+          }
+
+          sorted[i] = &labels[i];
+     }
+
+     if (!select_row_funcs( &funcs, format, premultiplied ))
+          return DFB_FALSE;
+
+     /* Shelves of labels of decreasing height. */
+     qsort( sorted, label_count, sizeof(Label*), compare_label_heights );
+
+     for (i = 0; i < label_count; i++) {
+          Label *label = sorted[i];
+
+          if (shelf_x > 0 && shelf_x + label->width > atlas_width) {
+               height       += shelf_height;
+               shelf_x       = 0;
+               shelf_height  = 0;
+          }
+
+          label->x = shelf_x;
+          label->y = height;
+
+          shelf_x += (label->width + align) & ~align;
+
+          width = MAX( width, label->x + label->width );
+
+          if (shelf_height < label->height)
+               shelf_height = label->height;
+     }
+
+     height += shelf_height;
+
+     DEBUG( "Packed %d labels into %dx%d\n", label_count, width, height );
+
+     pitch = (DFB_BYTES_PER_LINE( format, width ) + 7) & ~7;
+
+     data = calloc( height ?: 1, pitch ?: 1 );
+     if (!data) {
+          fprintf( stderr, "Could not allocate packed image!\n" );
+          return DFB_FALSE;
+     }
+
+     for (i = 0; i < label_count; i++) {
+          const Label *label = &labels[i];
+
+          convert_label( label, &funcs, data + label->y * pitch + DFB_BYTES_PER_LINE( format, label->x ), pitch );
+     }
+
+     write_image( stdout, format, width, height, pitch, data );
+
+     free( data );
+
+     if (index_file) {
+          fp = fopen( index_file, "w" );
+          if (!fp) {
+               fprintf( stderr, "Failed to create '%s'!\n", index_file );
+               return DFB_FALSE;
+          }
+
+          fprintf( fp, "# name x y width height baseline\n" );
+
+          for (i = 0; i < label_count; i++) {
+               const Label *label = &labels[i];
+
+               fprintf( fp, "%s %d %d %d %d %d\n",
+                        label->name, label->x, label->y, label->width, label->height, label->baseline );
+          }
+
+          fclose( fp );
+     }
+
+     return DFB_TRUE;
+}
+
+/**********************************************************************************************************************/
+
+int main( int argc, char *argv[] )
+{
+     FT_Error   ret;
+     int        i;
+     DFBBoolean result = DFB_FALSE;
+
+     /* Parse the command line. */
+     if (!parse_command_line( argc, argv ))
+          return -1;
+
+     init_row_tables();
+
+     ret = FT_Init_FreeType( &library );
+     if (ret) {
+          fprintf( stderr, "Initialization of the FreeType2 library failed!\n" );
+          return -2;
+     }
+
+     if (!load_labels())
+          goto out;
+
+     for (i = 0; i < label_count; i++) {
+          if (render_label( &labels[i] ))
+               goto out;
+     }
+
+     if (output)
+          result = write_labels();
+     else
+          result = write_atlas();
+
+out:
+     for (i = 0; i < label_count; i++) {
+          free( labels[i].coverage );
+          free( labels[i].text );
+          free( labels[i].font );
+          free( labels[i].name );
+     }
+
+     for (i = 0; i < font_count; i++)
+          FT_Done_Face( fonts[i].face );
+
+     FT_Done_FreeType( library );
+
+     return result ? 0 : -3;
+}